@@ -0,0 +1,699 @@
+#include "json.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <new>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace JSON;
+
+// Allocation counting
+static std::atomic<size_t> g_allocations = 0;
+static std::atomic<size_t> g_allocatedBytes = 0;
+
+static void* countedAlloc(size_t size, size_t alignment = 0)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    void* ptr = alignment > alignof(std::max_align_t) ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+                                                      : std::malloc(size ? size : 1);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new(size_t size)
+{
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size)
+{
+    return countedAlloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return countedAlloc(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return countedAlloc(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+// Process statistics
+/// <summary>
+/// Resets the peak resident set size, so the next read covers only what runs
+/// in between. Returns false where this is not supported.
+/// </summary>
+static bool resetPeakRss()
+{
+#if defined(__linux__)
+    FILE* file = std::fopen("/proc/self/clear_refs", "w");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    bool reset = std::fputs("5", file) >= 0;
+    return std::fclose(file) == 0 && reset;
+#else
+    return false;
+#endif
+}
+
+/// <summary>
+/// Returns the peak resident set size in KiB, or 0 if it is unknown.
+/// </summary>
+static size_t peakRss()
+{
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.rfind("VmHWM:", 0) == 0)
+        {
+            return std::strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+#endif
+    return 0;
+}
+
+/// <summary>
+/// Counts user-space cycles and instructions with perf_event_open, where the
+/// kernel allows it. Threads started after the counters are opened inherit
+/// them, and their counts are included, so work done on a ThreadPool is only
+/// counted if the pool starts afterwards.
+/// </summary>
+class Counters {
+    int m_cycles = -1;
+    int m_instructions = -1;
+
+#if defined(__linux__)
+    static int open(std::uint64_t config, int group)
+    {
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = config;
+        attr.disabled = group == -1 ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+    }
+
+    static std::uint64_t read(int fd)
+    {
+        std::uint64_t value = 0;
+        return ::read(fd, &value, sizeof(value)) == sizeof(value) ? value : 0;
+    }
+#endif
+
+public:
+    Counters()
+    {
+#if defined(__linux__)
+        m_cycles = open(PERF_COUNT_HW_CPU_CYCLES, -1);
+        if (m_cycles != -1)
+        {
+            m_instructions = open(PERF_COUNT_HW_INSTRUCTIONS, m_cycles);
+        }
+        if (m_instructions == -1 && m_cycles != -1)
+        {
+            close(m_cycles);
+            m_cycles = -1;
+        }
+#endif
+    }
+
+    Counters(const Counters& other) = delete;
+
+    Counters& operator=(const Counters& other) = delete;
+
+    ~Counters()
+    {
+#if defined(__linux__)
+        if (available())
+        {
+            close(m_instructions);
+            close(m_cycles);
+        }
+#endif
+    }
+
+    [[nodiscard]] bool available() const
+    {
+        return m_cycles != -1;
+    }
+
+    void start()
+    {
+#if defined(__linux__)
+        if (available())
+        {
+            ioctl(m_cycles, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(m_cycles, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    /// <summary>
+    /// Stops counting, and returns the cycles and instructions since `start()`.
+    /// </summary>
+    std::pair<std::uint64_t, std::uint64_t> stop()
+    {
+#if defined(__linux__)
+        if (available())
+        {
+            ioctl(m_cycles, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            return {read(m_cycles), read(m_instructions)};
+        }
+#endif
+        return {0, 0};
+    }
+};
+
+// Options
+struct Options {
+    // The size of each synthetic document, in MiB.
+    double size = 16;
+
+    // How long to repeat each benchmark for, in seconds.
+    double minTime = 0.5;
+
+    // Only run benchmarks whose "document/operation" name contains this.
+    std::string filter;
+
+    // Write JSON Lines rather than a table.
+    bool json = false;
+
+    std::string examples = CPP_JSON_EXAMPLES_DIR;
+};
+
+static Options parseOptions(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--json")
+        {
+            options.json = true;
+        }
+        else if (arg == "--size" && hasValue)
+        {
+            options.size = std::stod(argv[++i]);
+        }
+        else if (arg == "--min-time" && hasValue)
+        {
+            options.minTime = std::stod(argv[++i]);
+        }
+        else if (arg == "--filter" && hasValue)
+        {
+            options.filter = argv[++i];
+        }
+        else if (arg == "--examples" && hasValue)
+        {
+            options.examples = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Usage: cpp_json_bench [--size MiB] [--min-time seconds] [--filter text] "
+                         "[--examples directory] [--json]\n";
+            std::exit(arg == "--help" ? 0 : 1);
+        }
+    }
+    return options;
+}
+
+static const char* const OPERATIONS[] = {"lex", "parse", "parallel", "loadFile", "access", "format", "parFormat", "compact"};
+
+static bool selected(const Options& options, const std::string& document, const char* operation)
+{
+    return options.filter.empty() || (document + "/" + operation).find(options.filter) != std::string::npos;
+}
+
+static bool anySelected(const Options& options, const std::string& document)
+{
+    return std::any_of(std::begin(OPERATIONS), std::end(OPERATIONS),
+                       [&](const char* operation) { return selected(options, document, operation); });
+}
+
+// Synthetic documents
+/// <summary>
+/// Arrays of dictionaries nested `depth` levels deep, repeated to `size` bytes.
+/// </summary>
+static std::string makeDeep(size_t size, int depth = 64)
+{
+    std::string unit;
+    for (int i = 0; i < depth; i++)
+    {
+        unit += i % 2 ? "{\"child\": " : "[";
+    }
+    unit += "1";
+    for (int i = depth - 1; i >= 0; i--)
+    {
+        unit += i % 2 ? "}" : "]";
+    }
+
+    std::string json = "[";
+    while (json.size() < size)
+    {
+        json += json.size() > 1 ? "," : "";
+        json += unit;
+    }
+    return json + "]";
+}
+
+/// <summary>
+/// One dictionary with many keys, to `size` bytes.
+/// </summary>
+static std::string makeWide(size_t size)
+{
+    std::string json = "{";
+    for (size_t i = 0; json.size() < size; i++)
+    {
+        json += i ? ",\n" : "\n";
+        json += "    \"field_" + std::to_string(i) + "\": " + std::to_string(i * 7919 % 100000);
+    }
+    return json + "\n}";
+}
+
+/// <summary>
+/// An array of 4 KiB strings with occasional escapes, to `size` bytes.
+/// </summary>
+static std::string makeStrings(size_t size)
+{
+    std::string text;
+    for (size_t i = 0; text.size() < 4096; i++)
+    {
+        text += i % 16 == 15 ? "\\\"quoted\\\" " : "lorem ipsum ";
+    }
+
+    std::string json = "[";
+    while (json.size() < size)
+    {
+        json += json.size() > 1 ? ",\n    \"" : "\n    \"";
+        json += text + "\"";
+    }
+    return json + "\n]";
+}
+
+/// <summary>
+/// An array of integers and doubles, to `size` bytes.
+/// </summary>
+static std::string makeNumbers(size_t size)
+{
+    std::string json = "[";
+    for (size_t i = 0; json.size() < size; i++)
+    {
+        json += i ? "," : "";
+        json += i % 2 ? std::to_string(static_cast<std::int64_t>(i * 2654435761u % 4000000) - 2000000)
+                      : std::to_string(static_cast<double>(i) * 0.001 + 0.5);
+    }
+    return json + "]";
+}
+
+// Benchmarks
+struct Result {
+    std::string document;
+    std::string operation;
+    size_t bytes = 0;
+    size_t iterations = 0;
+    double ns = 0; // Best time per operation
+    size_t peakRss = 0;
+    double allocations = 0;
+    double allocatedBytes = 0;
+    double cycles = 0;
+    double instructions = 0;
+};
+
+struct Input {
+    std::string name;
+    std::string path;
+    std::string text;
+    bool temporary = false;
+};
+
+/// <summary>
+/// Runs `operation` once, then repeatedly for at least `minTime` seconds, and
+/// records the best time. `bytes` is the amount of JSON one run processes; it
+/// is 0 for operations which are not measured per byte.
+/// </summary>
+static Result measure(const std::string& document, const std::string& operation, size_t bytes,
+                      const std::function<void()>& run, const Options& options, Counters& counters)
+{
+    Result result{document, operation, bytes};
+
+    // The first run warms up, and is counted for memory use
+    bool hasPeak = resetPeakRss();
+    size_t allocations = g_allocations.load();
+    size_t allocatedBytes = g_allocatedBytes.load();
+    run();
+    result.allocations = static_cast<double>(g_allocations.load() - allocations);
+    result.allocatedBytes = static_cast<double>(g_allocatedBytes.load() - allocatedBytes);
+    result.peakRss = hasPeak ? peakRss() : 0;
+
+    using Clock = std::chrono::steady_clock;
+    double best = 1e300;
+    double total = 0;
+    counters.start();
+    while (total < options.minTime || result.iterations < 3)
+    {
+        auto start = Clock::now();
+        run();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        best = std::min(best, seconds);
+        total += seconds;
+        result.iterations++;
+    }
+    auto [cycles, instructions] = counters.stop();
+    result.ns = best * 1e9;
+    if (bytes > 0 && counters.available())
+    {
+        double processed = static_cast<double>(bytes) * static_cast<double>(result.iterations);
+        result.cycles = static_cast<double>(cycles) / processed;
+        result.instructions = static_cast<double>(instructions) / processed;
+    }
+    return result;
+}
+
+/// <summary>
+/// Returns a chain of keys and indices leading from `root` towards the middle
+/// of the tree, as used in a typical lookup.
+/// </summary>
+static std::vector<std::pair<std::string, int>> makeChain(const JsonObject& root)
+{
+    std::vector<std::pair<std::string, int>> chain;
+    const JsonObject* value = &root;
+    while (chain.size() < 16)
+    {
+        if (value->type() == Dictionary && value->size() > 0)
+        {
+            const JsonDict& dict = value->getDictRef();
+            const auto& entry = *(dict.begin() + static_cast<std::ptrdiff_t>(dict.size() / 2));
+            chain.emplace_back(std::string(entry.first.view()), -1);
+            value = &entry.second;
+        }
+        else if (value->type() == Array && value->size() > 0)
+        {
+            int index = static_cast<int>(value->size() / 2);
+            chain.emplace_back(std::string(), index);
+            value = &(*value)[index];
+        }
+        else
+        {
+            break;
+        }
+    }
+    return chain;
+}
+
+static void runBenchmarks(const Input& input, const Options& options, Counters& counters,
+                          std::vector<Result>& results)
+{
+    size_t bytes = input.text.size();
+
+    if (selected(options, input.name, "lex"))
+    {
+        results.push_back(measure(input.name, "lex", bytes, [&]() {
+            Lexer lexer(input.text);
+            size_t tokens = 0;
+            while (lexer.next().type != EValueType::End)
+            {
+                tokens++;
+            }
+            if (tokens == 0)
+            {
+                throw std::runtime_error("No tokens in " + input.name);
+            }
+        }, options, counters));
+    }
+
+    Document document;
+    Parser parser;
+    if (selected(options, input.name, "parse"))
+    {
+        results.push_back(measure(input.name, "parse", bytes, [&]() {
+            document.parse(input.text, parser);
+        }, options, counters));
+    }
+
+    if (selected(options, input.name, "parallel"))
+    {
+        results.push_back(measure(input.name, "parallel", bytes, [&]() {
+            document.parse(input.text, Parallel);
+        }, options, counters));
+    }
+
+    if (selected(options, input.name, "loadFile"))
+    {
+        results.push_back(measure(input.name, "loadFile", bytes, [&]() {
+            loadFile(input.path, document);
+        }, options, counters));
+    }
+
+    const JsonObject& root = document.parse(input.text, parser);
+    if (selected(options, input.name, "access"))
+    {
+        std::vector<std::pair<std::string, int>> chain = makeChain(root);
+        volatile size_t sink = 0;
+        results.push_back(measure(input.name, "access", 0, [&]() {
+            const JsonObject* value = &root;
+            for (const auto& [key, index] : chain)
+            {
+                value = index < 0 ? &(*value)[key] : &(*value)[index];
+            }
+            sink = sink + value->type();
+        }, options, counters));
+    }
+
+    if (selected(options, input.name, "format"))
+    {
+        size_t formatted = root.format().size();
+        results.push_back(measure(input.name, "format", formatted, [&]() {
+            std::string text = root.format();
+            if (text.size() != formatted)
+            {
+                throw std::runtime_error("Inconsistent output for " + input.name);
+            }
+        }, options, counters));
+    }
+
+    if (selected(options, input.name, "parFormat"))
+    {
+        FormatOptions format;
+        format.pool = &ThreadPool::shared();
+        size_t formatted = root.format(format).size();
+        results.push_back(measure(input.name, "parFormat", formatted, [&]() {
+            std::string text = root.format(format);
+            if (text.size() != formatted)
+            {
+                throw std::runtime_error("Inconsistent output for " + input.name);
+            }
+        }, options, counters));
+    }
+
+    if (selected(options, input.name, "compact"))
+    {
+        size_t formatted = root.format({.pretty = false}).size();
+        results.push_back(measure(input.name, "compact", formatted, [&]() {
+            std::string text = root.format({.pretty = false});
+            if (text.size() != formatted)
+            {
+                throw std::runtime_error("Inconsistent output for " + input.name);
+            }
+        }, options, counters));
+    }
+}
+
+// Output
+static void printTable(const std::vector<Result>& results, bool counters)
+{
+    std::cout << std::left << std::setw(24) << "document" << std::setw(10) << "operation" << std::right
+              << std::setw(12) << "bytes" << std::setw(12) << "MB/s" << std::setw(16) << "ns/op"
+              << std::setw(12) << "peak KiB" << std::setw(12) << "allocs/op" << std::setw(14) << "alloc B/op";
+    if (counters)
+    {
+        std::cout << std::setw(10) << "cyc/B" << std::setw(10) << "ins/B";
+    }
+    std::cout << "\n";
+
+    std::cout << std::fixed;
+    for (const Result& r : results)
+    {
+        std::cout << std::left << std::setw(24) << r.document << std::setw(10) << r.operation << std::right
+                  << std::setw(12) << r.bytes << std::setw(12) << std::setprecision(1);
+        if (r.bytes > 0)
+        {
+            std::cout << static_cast<double>(r.bytes) * 1e3 / r.ns;
+        }
+        else
+        {
+            std::cout << "-";
+        }
+        std::cout << std::setw(16) << r.ns << std::setw(12) << r.peakRss << std::setw(12)
+                  << std::setprecision(0) << r.allocations << std::setw(14) << r.allocatedBytes;
+        if (counters)
+        {
+            std::cout << std::setprecision(2) << std::setw(10) << r.cycles << std::setw(10) << r.instructions;
+        }
+        std::cout << "\n";
+    }
+}
+
+static void printJson(const std::vector<Result>& results, bool counters)
+{
+    LineWriter writer(std::cout);
+    for (const Result& r : results)
+    {
+        JsonDict line = {
+            {"document", JsonObject(r.document)},
+            {"operation", JsonObject(r.operation)},
+            {"bytes", JsonObject(static_cast<std::uint64_t>(r.bytes))},
+            {"iterations", JsonObject(static_cast<std::uint64_t>(r.iterations))},
+            {"ns_per_op", JsonObject(r.ns)},
+            {"mb_per_s", r.bytes ? JsonObject(static_cast<double>(r.bytes) * 1e3 / r.ns) : JsonObject()},
+            {"peak_rss_kib", JsonObject(static_cast<std::uint64_t>(r.peakRss))},
+            {"allocations_per_op", JsonObject(r.allocations)},
+            {"allocated_bytes_per_op", JsonObject(r.allocatedBytes)},
+            {"cycles_per_byte", counters && r.bytes ? JsonObject(r.cycles) : JsonObject()},
+            {"instructions_per_byte", counters && r.bytes ? JsonObject(r.instructions) : JsonObject()},
+        };
+        writer.write(JsonObject(std::move(line)));
+    }
+    writer.flush();
+}
+
+int main(int argc, char** argv)
+{
+    Options options = parseOptions(argc, argv);
+
+    // The example corpus, and synthetic documents written to temporary files
+    std::vector<Input> inputs;
+    std::vector<std::filesystem::path> examples;
+    for (const auto& entry : std::filesystem::directory_iterator(options.examples))
+    {
+        if (entry.path().extension() == ".json")
+        {
+            examples.push_back(entry.path());
+        }
+    }
+    std::sort(examples.begin(), examples.end());
+    for (const auto& path : examples)
+    {
+        if (!anySelected(options, path.filename().string()))
+        {
+            continue;
+        }
+        MappedFile file(path.string());
+        inputs.push_back({path.filename().string(), path.string(), std::string(file.view())});
+    }
+
+    auto size = static_cast<size_t>(options.size * 1024 * 1024);
+    std::pair<const char*, std::string (*)(size_t)> generators[] = {
+        {"deep", [](size_t n) { return makeDeep(n); }},
+        {"wide", makeWide},
+        {"strings", makeStrings},
+        {"numbers", makeNumbers},
+    };
+    for (const auto& [name, generate] : generators)
+    {
+        std::string document = std::string(name) + ".synthetic";
+        if (!anySelected(options, document))
+        {
+            continue;
+        }
+        std::filesystem::path path = std::filesystem::temp_directory_path() / ("cpp_json_bench_" + document + ".json");
+        Input input{document, path.string(), generate(size), true};
+        std::ofstream(path, std::ios::binary).write(input.text.data(), static_cast<std::streamsize>(input.text.size()));
+        inputs.push_back(std::move(input));
+    }
+
+    // The shared pool, which parallel parses and formats run on, must start
+    // after the counters are opened so that its workers are counted too
+    Counters counters;
+    ThreadPool::shared();
+    std::vector<Result> results;
+    for (Input& input : inputs)
+    {
+        runBenchmarks(input, options, counters, results);
+        if (input.temporary)
+        {
+            std::filesystem::remove(input.path);
+            input.text = std::string();
+        }
+    }
+
+    if (options.json)
+    {
+        printJson(results, counters.available());
+    }
+    else
+    {
+        printTable(results, counters.available());
+        if (!counters.available())
+        {
+            std::cout << "(perf_event_open is unavailable, so cycles and instructions are not reported)\n";
+        }
+    }
+    return 0;
+}
@@ -1,172 +1,504 @@
 #include "json.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define JSON_HAS_MMAP true
+#else
+#define JSON_HAS_MMAP false
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define JSON_HAS_X86_SIMD true
+#else
+#define JSON_HAS_X86_SIMD false
+#endif
+
+#if JSON_ENABLE_STATS == true
+#include <chrono>
+
+// Runs `statement` if a ParseStats is being collected into
+#define JSON_STAT(statement) \
+    if (m_stats != nullptr) \
+    { \
+        statement; \
+    }
+
+// Adds the time until the end of the enclosing scope to `total`
+#define JSON_TIME(total) PhaseTimer phaseTimer(total)
+#else
+#define JSON_STAT(statement)
+#define JSON_TIME(total)
+#endif
+
 namespace JSON
 {
-    std::string getIndent(int indent = 0)
+    // Statistics
+#if JSON_ENABLE_STATS == true
+    /// <summary>
+    /// Adds the time from its construction to its destruction to `total`.
+    /// </summary>
+    class PhaseTimer {
+        std::uint64_t& m_total;
+        std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+
+    public:
+        explicit PhaseTimer(std::uint64_t& total) : m_total(total)
+        {
+        }
+
+        PhaseTimer(const PhaseTimer& other) = delete;
+
+        PhaseTimer& operator=(const PhaseTimer& other) = delete;
+
+        ~PhaseTimer()
+        {
+            auto elapsed = std::chrono::steady_clock::now() - m_start;
+            m_total += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    };
+
+    CountingResource::CountingResource(std::pmr::memory_resource* upstream) : m_upstream(upstream)
     {
-        auto size = indent * 4;
-        auto indentString = std::string(size, ' ');
-        return indentString;
     }
 
-    std::string formatLine(const std::string& value, int indent, bool end)
+    void CountingResource::setStats(ParseStats* stats)
     {
-        std::string line;
-        line += getIndent(indent);
-        line += value;
-        if (!end)
-        {
-            line += ",";
-        }
-        line += "\n";
-        return line;
+        m_stats = stats;
     }
 
-    std::string formatLine(const std::string& key, const std::string& value,
-        int indent, bool end)
+    void* CountingResource::do_allocate(size_t bytes, size_t alignment)
     {
-        std::string line;
-        line += getIndent(indent);
-        line += "\"" + key + "\"" + ": " + value;
-        if (!end)
+        if (m_stats != nullptr)
         {
-            line += ",";
+            m_stats->allocations++;
+            m_stats->allocatedBytes += bytes;
         }
-        line += "\n";
-        return line;
+        return m_upstream->allocate(bytes, alignment);
     }
 
-// General operators
-    std::ostream& operator<<(std::ostream& o, JsonArray& a)
+    void CountingResource::do_deallocate(void* p, size_t bytes, size_t alignment)
     {
-        return o << JsonObject(a).format();
+        m_upstream->deallocate(p, bytes, alignment);
     }
 
-    std::ostream& operator<<(std::ostream& o, JsonDict& d)
+    bool CountingResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
     {
-        return o << JsonObject(d).format();
+        return this == &other;
     }
+#endif
 
-// NullType
-    std::string NullValue::format()
+    // Writer
+    // Constant initialised, so formatting works during the static
+    // initialisation of other files
+    static constexpr std::string_view INDENT = "                                                                "
+                                               "                                                                "
+                                               "                                                                "
+                                               "                                                                ";
+    static_assert(INDENT.size() == 256);
+
+    Writer::Writer(std::string& output, const FormatOptions& options)
+        : m_output(&output), m_options(options)
     {
-        return "NullType";
     }
 
-    std::ostream& NullValue::operator<<(std::ostream& o)
+    Writer::Writer(std::ostream& stream, const FormatOptions& options)
+        : m_output(&m_buffer), m_stream(&stream), m_options(options)
     {
-        return o << format();
+        m_buffer.reserve(FLUSH_SIZE);
     }
 
-// Bool
-    bool BoolValue::value() const
+    Writer::~Writer()
     {
-        return m_value;
+        flush();
     }
 
-    std::string BoolValue::format()
+    void Writer::write(const JsonObject& value)
     {
-        std::string boolString(m_value ? std::string("true") : std::string("false"));
-#if DEBUG_TYPE == true
-        boolString += " (bool)";
-#endif
-        return boolString;
+        writeValue(value, 0);
+        checkFlush();
     }
 
-    std::ostream& BoolValue::operator<<(std::ostream& o)
+    void Writer::write(const JsonArray& value)
     {
-        return o << format();
+        writeArray(value, 0);
+        checkFlush();
     }
 
-    BoolValue::BoolValue(const BoolValue& other)
+    void Writer::write(const JsonDict& value)
     {
-        *this = other;
+        writeDict(value, 0);
+        checkFlush();
     }
 
-// Int
-    int IntValue::value() const
+    void Writer::flush()
     {
-        return m_value;
+        if (m_stream != nullptr && !m_buffer.empty())
+        {
+            m_stream->write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+            m_buffer.clear();
+        }
     }
 
-    std::string IntValue::format()
+    void Writer::checkFlush()
     {
-        std::string intString = std::to_string(m_value);
-#if DEBUG_TYPE == true
-        intString += " (int)";
-#endif
-        return intString;
+        if (m_stream != nullptr && m_buffer.size() >= FLUSH_SIZE)
+        {
+            flush();
+        }
     }
 
-    IntValue::IntValue(const IntValue& other)
+    void Writer::writeIndent(int depth)
     {
-        *this = other;
+        if (!m_options.pretty)
+        {
+            return;
+        }
+        size_t size = static_cast<size_t>(depth) * static_cast<size_t>(std::max(m_options.indentWidth, 0));
+        while (size > INDENT.size())
+        {
+            m_output->append(INDENT);
+            size -= INDENT.size();
+        }
+        m_output->append(INDENT, 0, size);
     }
 
-    std::ostream& IntValue::operator<<(std::ostream& o)
+    template<typename T>
+    void Writer::writeInteger(T value)
     {
-        return o << format();
+        // Format straight into the end of the output
+        size_t size = m_output->size();
+        m_output->resize(size + 24);
+        char* data = m_output->data();
+        auto result = std::to_chars(data + size, data + m_output->size(), value);
+        m_output->resize(static_cast<size_t>(result.ptr - data));
     }
 
-// Double
-    double DoubleValue::value() const
+    void Writer::writeNumber(double value)
     {
-        return m_value;
+        // JSON has no representation for NaN or infinity
+        if (!std::isfinite(value))
+        {
+            m_output->append("null");
+            return;
+        }
+
+        // Shortest representation which reads back as exactly the same value
+        size_t size = m_output->size();
+        m_output->resize(size + 32);
+        char* data = m_output->data();
+        auto result = std::to_chars(data + size, data + m_output->size(), value);
+        std::string_view digits(data + size, static_cast<size_t>(result.ptr - (data + size)));
+
+        // Keep whole numbers recognisable as doubles when read back
+        bool integral = digits.find_first_of(".e") == std::string_view::npos;
+        m_output->resize(static_cast<size_t>(result.ptr - data));
+        if (integral)
+        {
+            m_output->append(".0");
+        }
     }
 
-    std::string DoubleValue::format()
+    // The escape for each character which needs one: the character after the
+    // backslash, or 'u' for a \u00XX escape
+    static constexpr std::array<char, 256> ESCAPES = []()
+    {
+        std::array<char, 256> escapes{};
+        for (int c = 0; c < 0x20; c++)
+        {
+            escapes[c] = 'u';
+        }
+        escapes['"'] = '"';
+        escapes['\\'] = '\\';
+        escapes['\b'] = 'b';
+        escapes['\f'] = 'f';
+        escapes['\n'] = 'n';
+        escapes['\r'] = 'r';
+        escapes['\t'] = 't';
+        return escapes;
+    }();
+
+    void Writer::writeString(std::string_view text)
+    {
+        m_output->push_back('"');
+
+        // Copy the runs between characters which need escaping in one go
+        size_t run = 0;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            char escape = ESCAPES[static_cast<unsigned char>(text[i])];
+            if (escape == 0)
+            {
+                continue;
+            }
+            m_output->append(text, run, i - run);
+            m_output->push_back('\\');
+            m_output->push_back(escape);
+            if (escape == 'u')
+            {
+                const char* digits = "0123456789abcdef";
+                auto c = static_cast<unsigned char>(text[i]);
+                m_output->append("00");
+                m_output->push_back(digits[c >> 4]);
+                m_output->push_back(digits[c & 0xF]);
+            }
+            run = i + 1;
+        }
+        m_output->append(text, run);
+        m_output->push_back('"');
+    }
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+    void Writer::writeValue(const JsonObject& value, int depth)
     {
-        std::string doubleString = std::to_string(m_value);
+        switch (value.type())
+        {
+        case (Bool):
+        {
+            m_output->append(value.getBool() ? "true" : "false");
+#if DEBUG_TYPE == true
+            m_output->append(" (bool)");
+#endif
+            break;
+        }
+        case (Int):
+        {
+            writeInteger(value.getInt64());
+#if DEBUG_TYPE == true
+            m_output->append(" (int)");
+#endif
+            break;
+        }
+        case (UInt):
+        {
+            writeInteger(value.getUInt64());
+#if DEBUG_TYPE == true
+            m_output->append(" (uint)");
+#endif
+            break;
+        }
+        case (Double):
+        {
+            writeNumber(value.getDouble());
+#if DEBUG_TYPE == true
+            m_output->append(" (double)");
+#endif
+            break;
+        }
+        case (String):
+        {
+            writeString(value.getStringView());
 #if DEBUG_TYPE == true
-        doubleString += " (double)";
+            m_output->append(" (string)");
 #endif
-        return doubleString;
+            break;
+        }
+        case (Array):
+        {
+            writeArray(value.getArrayRef(), depth);
+            break;
+        }
+        case (Dictionary):
+        {
+            writeDict(value.getDictRef(), depth);
+            break;
+        }
+        default:
+        {
+            m_output->append("null");
+            break;
+        }
+        }
     }
 
-    DoubleValue::DoubleValue(const DoubleValue& other)
+    // A template, so that containers written on the calling thread do not
+    // allocate a std::function for their chunks
+    template<typename Container, typename Write>
+    bool Writer::writeParallel(const Container& container, const Write& write)
     {
-        *this = other;
+        size_t count = container.size();
+        if (m_options.pool == nullptr || count < PARALLEL_MIN_ELEMENTS)
+        {
+            return false;
+        }
+
+        // Lazy containers are parsed by their Document's single Parser, so they
+        // cannot be expanded by the chunks' threads
+        for (const auto& element : container)
+        {
+            if constexpr (std::is_same_v<Container, JsonDict>)
+            {
+                element.second.expandLazy();
+            }
+            else
+            {
+                element.expandLazy();
+            }
+        }
+        ThreadPool& pool = *m_options.pool;
+        size_t chunk = std::max(count / (pool.size() * 8), PARALLEL_MIN_CHUNK);
+        size_t chunks = (count + chunk - 1) / chunk;
+
+        // Chunks are split no further, as this level already keeps the pool busy
+        FormatOptions options = m_options;
+        options.pool = nullptr;
+
+        // Render a few chunks per thread at a time, so only that much of the
+        // output is held apart from the stream or string it goes to
+        size_t batch = std::min(pool.size() * 4, chunks);
+        std::vector<std::string> outputs(batch);
+        for (size_t start = 0; start < chunks; start += batch)
+        {
+            size_t size = std::min(batch, chunks - start);
+            pool.parallelFor(size, [&](size_t i)
+            {
+                outputs[i].clear();
+                Writer writer(outputs[i], options);
+                size_t first = (start + i) * chunk;
+                write(writer, first, std::min(first + chunk, count));
+            });
+            for (size_t i = 0; i < size; i++)
+            {
+                // Streams take each chunk directly, rather than through the buffer
+                if (m_stream != nullptr)
+                {
+                    flush();
+                    m_stream->write(outputs[i].data(), static_cast<std::streamsize>(outputs[i].size()));
+                }
+                else
+                {
+                    m_output->append(outputs[i]);
+                }
+            }
+        }
+        return true;
     }
 
-    std::ostream& DoubleValue::operator<<(std::ostream& o)
+    void Writer::writeArray(const JsonArray& array, int depth)
     {
-        return o << format();
+        m_output->push_back('[');
+        if (m_options.pretty)
+        {
+            m_output->push_back('\n');
+        }
+        if (!writeParallel(array, [&](Writer& writer, size_t first, size_t last)
+                           { writer.writeElements(array, first, last, depth); }))
+        {
+            writeElements(array, 0, array.size(), depth);
+        }
+        writeIndent(depth);
+        m_output->push_back(']');
     }
 
-// StringType
-    std::string StringValue::value()
+    void Writer::writeElements(const JsonArray& array, size_t first, size_t last, int depth)
     {
-        return m_value;
+        for (size_t i = first; i < last; i++)
+        {
+            writeIndent(depth + 1);
+            writeValue(array[i], depth + 1);
+            if (i + 1 != array.size())
+            {
+                m_output->push_back(',');
+            }
+            if (m_options.pretty)
+            {
+                m_output->push_back('\n');
+            }
+            checkFlush();
+        }
     }
 
-    std::string StringValue::format()
+    void Writer::writeDict(const JsonDict& dict, int depth)
     {
+        // Collect the entries to sort them, keeping any entries collected by
+        // the dictionaries enclosing this one
+        size_t base = m_entries.size();
+        if (m_options.sortKeys)
+        {
+            for (const auto& entry : dict)
+            {
+                m_entries.push_back(&entry);
+            }
+            std::stable_sort(m_entries.begin() + static_cast<std::ptrdiff_t>(base), m_entries.end(),
+                             [](const auto* a, const auto* b) { return a->first < b->first; });
+        }
 
-        std::string string = "\"" + m_value + "\"";
-#if DEBUG_TYPE == true
-        string += " (string)";
-#endif
-        return string;
+        m_output->push_back('{');
+        if (m_options.pretty)
+        {
+            m_output->push_back('\n');
+        }
+        // Chunks read the sorted entries from this Writer, which is left alone
+        // until they have all finished
+        if (!writeParallel(dict, [&](Writer& writer, size_t first, size_t last)
+                           { writer.writeEntries(dict, m_entries, base, first, last, depth); }))
+        {
+            writeEntries(dict, m_entries, base, 0, dict.size(), depth);
+        }
+        writeIndent(depth);
+        m_output->push_back('}');
+        m_entries.resize(base);
     }
 
-    StringValue::StringValue(const StringValue& other)
+    void Writer::writeEntries(const JsonDict& dict, const std::vector<const JsonDict::value_type*>& sorted,
+                              size_t base, size_t first, size_t last, int depth)
     {
-        *this = other;
+        for (size_t i = first; i < last; i++)
+        {
+            // Index `sorted` afresh each time, as nested dictionaries may grow it
+            const auto& [k, v] = m_options.sortKeys ? *sorted[base + i]
+                                                    : *(dict.begin() + static_cast<std::ptrdiff_t>(i));
+            writeIndent(depth + 1);
+            writeString(k);
+            m_output->append(m_options.pretty ? ": " : ":");
+
+            // Containers start on their own line
+            if (m_options.pretty && (v.type() == Dictionary || v.type() == Array))
+            {
+                m_output->push_back('\n');
+                writeIndent(depth + 1);
+            }
+            writeValue(v, depth + 1);
+            if (i + 1 != dict.size())
+            {
+                m_output->push_back(',');
+            }
+            if (m_options.pretty)
+            {
+                m_output->push_back('\n');
+            }
+            checkFlush();
+        }
+    }
+
+#pragma clang diagnostic pop
+
+// General operators
+    std::ostream& operator<<(std::ostream& o, JsonArray& a)
+    {
+        Writer(o).write(a);
+        return o;
     }
 
-    std::ostream& StringValue::operator<<(std::ostream& o)
+    std::ostream& operator<<(std::ostream& o, JsonDict& d)
     {
-        return o << format();
+        Writer(o).write(d);
+        return o;
     }
 
 // Array
-    ArrayValue::ArrayValue(const JsonArray& value)
+    ArrayValue::ArrayValue(const JsonArray& value) : m_value(value)
+    {
+    }
+
+    ArrayValue::ArrayValue(JsonArray&& value) : m_value(std::move(value))
     {
-        m_value.clear();
-        for (const JsonObject& v : value)
-        {
-            m_value.emplace_back(v);
-        }
     }
 
     JsonArray ArrayValue::value()
@@ -174,29 +506,25 @@ namespace JSON
         return m_value;
     }
 
+    const JsonArray& ArrayValue::ref() const
+    {
+        return m_value;
+    }
+
     std::string ArrayValue::format()
     {
-        std::string arrayString = "[\n";
-        CURRENT_INDENT++;
-        int count = 1;
-        for (auto& v : m_value)
-        {
-            bool at_end = (count == m_value.size());
-            arrayString += formatLine(v.format(), CURRENT_INDENT, at_end);
-            count++;
-        }
-        CURRENT_INDENT--;
-        arrayString += getIndent(CURRENT_INDENT) + "]";
+        std::string arrayString;
+        Writer(arrayString).write(m_value);
         return arrayString;
     }
 
 // Dictionary
-    DictValue::DictValue(const JsonDict& value)
+    DictValue::DictValue(const JsonDict& value) : m_value(value)
+    {
+    }
+
+    DictValue::DictValue(JsonDict&& value) : m_value(std::move(value))
     {
-        for (const auto& [k, v] : value)
-        {
-            m_value[k] = v;
-        }
     }
 
     JsonDict DictValue::value()
@@ -204,703 +532,3866 @@ namespace JSON
         return m_value;
     }
 
+    const JsonDict& DictValue::ref() const
+    {
+        return m_value;
+    }
+
     std::string DictValue::format()
     {
-        std::string dictString = "{\n";
-        CURRENT_INDENT++;
-        int count = 1;
-        for (auto& [k, v] : m_value)
-        {
-            bool at_end = (count == m_value.size());
-            std::string new_line = (v.type() == Dictionary || v.type() == Array)
-                                   ? ("\n" + getIndent(CURRENT_INDENT))
-                                   : "";
-            dictString += formatLine(k, new_line + v.format(), CURRENT_INDENT, at_end);
-            count++;
-        }
-        CURRENT_INDENT--;
-        dictString += getIndent(CURRENT_INDENT) + "}";
+        std::string dictString;
+        Writer(dictString).write(m_value);
         return dictString;
     }
 
-    // JSON Object
-    JsonObject::JsonObject()
+    // Keys
+    JsonKey::JsonKey(std::string_view key)
     {
-        m_value = nullptr;
-        m_type = EValueType::Null;
+        if (key.size() <= SMALL_KEY_SIZE)
+        {
+            std::memcpy(m_data, key.data(), key.size());
+            m_size = static_cast<std::uint8_t>(key.size());
+            return;
+        }
+        if (key.size() > UINT32_MAX)
+        {
+            throw std::runtime_error("Key too long: " + std::to_string(key.size()) + " bytes");
+        }
+        char* data = new char[key.size()];
+        std::memcpy(data, key.data(), key.size());
+        auto size = static_cast<std::uint32_t>(key.size());
+        std::memcpy(m_data, &data, sizeof(data));
+        std::memcpy(m_data + sizeof(data), &size, sizeof(size));
+        m_size = HEAP_KEY;
     }
 
-    JsonObject::JsonObject(const JsonObject& other)
+    JsonKey::JsonKey(const JsonKey& other) : JsonKey(other.view())
     {
-        *this = other;
-        m_type = other.m_type;
     }
 
-    JsonObject::JsonObject(bool value)
+    JsonKey JsonKey::borrow(std::string_view key)
     {
-        m_value = std::make_unique<BoolValue>(value);
-        m_type = Bool;
+        if (key.size() <= SMALL_KEY_SIZE)
+        {
+            return {key};
+        }
+        JsonKey result;
+        const char* data = key.data();
+        auto size = static_cast<std::uint32_t>(key.size());
+        std::memcpy(result.m_data, &data, sizeof(data));
+        std::memcpy(result.m_data + sizeof(data), &size, sizeof(size));
+        result.m_size = BORROWED;
+        return result;
     }
 
-    JsonObject::JsonObject(int value)
+    void JsonKey::release()
     {
-        m_value = std::make_unique<IntValue>(value);
-        m_type = Int;
+        if (m_size == HEAP_KEY)
+        {
+            delete[] data();
+        }
+        m_size = 0;
     }
 
-    JsonObject::JsonObject(double value)
+    JsonKey& JsonKey::operator=(const JsonKey& other)
     {
-        m_value = std::make_unique<DoubleValue>(value);
-        m_type = Double;
+        if (this != &other)
+        {
+            JsonKey copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
     }
 
-    JsonObject::JsonObject(const std::string& value)
+    JsonKey& JsonKey::operator=(JsonKey&& other) noexcept
     {
-        m_value = std::make_unique<StringValue>(value);
-        m_type = EValueType::String;
+        if (this != &other)
+        {
+            release();
+            std::memcpy(m_data, other.m_data, sizeof(m_data));
+            m_size = other.m_size;
+            other.m_size = 0;
+        }
+        return *this;
     }
 
-    JsonObject::JsonObject(const JsonArray& value)
+    // Key table
+    std::string_view KeyTable::intern(std::string_view key, std::pmr::memory_resource* arena, bool borrow)
     {
-        m_value = std::make_unique<ArrayValue>(value);
-        m_type = Array;
+        if ((m_used.size() + 1) * 2 > m_slots.size())
+        {
+            grow();
+        }
+
+        auto hash = static_cast<std::uint32_t>(std::hash<std::string_view>()(key));
+        size_t mask = m_slots.size() - 1;
+        size_t index = hash & mask;
+        for (; m_slots[index].data != nullptr; index = (index + 1) & mask)
+        {
+            const Slot& slot = m_slots[index];
+            if (slot.hash == hash && std::string_view(slot.data, slot.size) == key)
+            {
+                return {slot.data, slot.size};
+            }
+        }
+
+        // New key, store it once
+        const char* data = key.data();
+        if (!borrow)
+        {
+            auto* copy = static_cast<char*>(arena->allocate(std::max<size_t>(key.size(), 1), 1));
+            std::memcpy(copy, key.data(), key.size());
+            data = copy;
+        }
+        m_slots[index] = {data, static_cast<std::uint32_t>(key.size()), hash};
+        m_used.push_back(static_cast<std::uint32_t>(index));
+        return {data, key.size()};
     }
 
-    JsonObject::JsonObject(const JsonDict& value)
+    void KeyTable::grow()
     {
-        m_value = std::make_unique<DictValue>(value);
-        m_type = Dictionary;
+        std::vector<Slot> slots(std::max<size_t>(m_slots.size() * 2, 64));
+        size_t mask = slots.size() - 1;
+        for (std::uint32_t& used : m_used)
+        {
+            const Slot& slot = m_slots[used];
+            size_t index = slot.hash & mask;
+            while (slots[index].data != nullptr)
+            {
+                index = (index + 1) & mask;
+            }
+            slots[index] = slot;
+            used = static_cast<std::uint32_t>(index);
+        }
+        m_slots = std::move(slots);
     }
 
-    BoolValue& JsonObject::asBool() const
+    size_t KeyTable::size() const
     {
-        return *dynamic_cast<BoolValue*>(m_value.get());
+        return m_used.size();
     }
 
-    IntValue& JsonObject::asInt() const
+    void KeyTable::clear()
     {
-        return *dynamic_cast<IntValue*>(m_value.get());
+        for (std::uint32_t used : m_used)
+        {
+            m_slots[used] = Slot();
+        }
+        m_used.clear();
     }
 
-    DoubleValue& JsonObject::asDouble() const
+    // Dictionary storage
+    JsonDict::JsonDict() = default;
+
+    JsonDict::JsonDict(const allocator_type& allocator) : m_entries(allocator), m_index(allocator)
     {
-        return *dynamic_cast<DoubleValue*>(m_value.get());
     }
 
-    StringValue& JsonObject::asString() const
+    JsonDict::JsonDict(std::initializer_list<std::pair<std::string_view, JsonObject>> values)
     {
-        return *dynamic_cast<StringValue*>(m_value.get());
+        reserve(values.size());
+        for (const auto& value : values)
+        {
+            insert_or_assign(value.first, value.second);
+        }
     }
 
-    ArrayValue& JsonObject::asArray() const
+    JsonDict::JsonDict(const JsonDict& other) : m_entries(other.m_entries), m_index(other.m_index)
     {
-        return *dynamic_cast<ArrayValue*>(m_value.get());
     }
 
-    DictValue& JsonObject::asDict() const
+    JsonDict::JsonDict(const JsonDict& other, const allocator_type& allocator)
+        : m_entries(other.m_entries, allocator), m_index(other.m_index, allocator)
     {
-        return *dynamic_cast<DictValue*>(m_value.get());
     }
 
-    bool JsonObject::getBool() const
+    JsonDict::JsonDict(JsonDict&& other) noexcept
+        : m_entries(std::move(other.m_entries)), m_index(std::move(other.m_index))
     {
-        return asBool().value();
     }
 
-    int JsonObject::getInt() const
+    JsonDict::~JsonDict() = default;
+
+    JsonDict& JsonDict::operator=(const JsonDict& other) = default;
+
+    JsonDict& JsonDict::operator=(JsonDict&& other) = default;
+
+    JsonDict::allocator_type JsonDict::get_allocator() const
     {
-        return asInt().value();
+        return m_entries.get_allocator();
     }
 
-    double JsonObject::getDouble() const
+    size_t JsonDict::size() const
     {
-        return asDouble().value();
+        return m_entries.size();
     }
 
-    std::string JsonObject::getString() const
+    bool JsonDict::empty() const
     {
-        return asString().value();
+        return m_entries.empty();
     }
 
-    JsonArray JsonObject::getArray() const
+    JsonDict::iterator JsonDict::begin()
     {
-        return asArray().value();
+        return m_entries.begin();
     }
 
-    JsonDict JsonObject::getDict() const
+    JsonDict::iterator JsonDict::end()
     {
-        return asDict().value();
+        return m_entries.end();
     }
 
-    std::string JsonObject::format() const
+    JsonDict::const_iterator JsonDict::begin() const
     {
-        if (m_value == nullptr)
-        {
-            return "NULL";
-        }
-
-        return m_value->format();
+        return m_entries.begin();
     }
 
-    JsonObject& JsonObject::operator=(const JsonObject& other)
+    JsonDict::const_iterator JsonDict::end() const
     {
-        switch (other.m_type)
-        {
-        case (Bool):
-        {
-            m_value = std::make_unique<BoolValue>(other.getBool());
-            break;
-        }
-        case (Int):
-        {
-            m_value = std::make_unique<IntValue>(other.getInt());
-            break;
-        }
-        case (Double):
+        return m_entries.end();
+    }
+
+    size_t JsonDict::lookup(std::string_view key) const
+    {
+        // Small dictionaries: a linear scan beats hashing the key
+        if (m_index.empty())
         {
-            m_value = std::make_unique<DoubleValue>(other.getDouble());
-            break;
+            for (size_t i = 0; i < m_entries.size(); i++)
+            {
+                std::string_view entry = m_entries[i].first.view();
+
+                // Interned keys match by pointer
+                if ((entry.data() == key.data() && entry.size() == key.size()) || entry == key)
+                {
+                    return i;
+                }
+            }
+            return std::string_view::npos;
         }
-        case (String):
+
+        size_t mask = m_index.size() - 1;
+        for (size_t slot = std::hash<std::string_view>()(key) & mask;; slot = (slot + 1) & mask)
         {
-            m_value = std::make_unique<StringValue>(other.getString());
-            break;
+            std::uint32_t entry = m_index[slot];
+            if (entry == 0)
+            {
+                return std::string_view::npos;
+            }
+            std::string_view candidate = m_entries[entry - 1].first.view();
+            if ((candidate.data() == key.data() && candidate.size() == key.size()) || candidate == key)
+            {
+                return entry - 1;
+            }
         }
-        case (Array):
+    }
+
+    void JsonDict::insertIndex(size_t entry)
+    {
+        size_t mask = m_index.size() - 1;
+        size_t slot = std::hash<std::string_view>()(m_entries[entry].first.view()) & mask;
+        while (m_index[slot] != 0)
         {
-            m_value = std::make_unique<ArrayValue>(other.getArray());
-            break;
+            slot = (slot + 1) & mask;
         }
-        case (Dictionary):
+        m_index[slot] = static_cast<std::uint32_t>(entry + 1);
+    }
+
+    void JsonDict::rebuildIndex()
+    {
+        if (m_entries.size() < HASH_THRESHOLD)
         {
-            m_value = std::make_unique<DictValue>(other.getDict());
-            break;
+            m_index.clear();
+            return;
         }
-        default:
+
+        // Keep the table at most half full
+        m_index.assign(std::bit_ceil(m_entries.size() * 2), 0);
+        for (size_t i = 0; i < m_entries.size(); i++)
         {
-            break;
-        }
+            insertIndex(i);
         }
-        m_type = other.m_type;
-        return *this;
     }
 
-    JsonObject& JsonObject::operator[](const std::string& key)
+    JsonDict::iterator JsonDict::find(std::string_view key)
     {
-        if (m_type != Dictionary && m_value == nullptr)
-        {
-            throw std::runtime_error("Invalid type, wanted Dictionary");
-        }
-        if (!hasKey(key)) {
-            throw std::runtime_error("Missing key: " + key);
-        }
-        return asDict()[key];
+        size_t entry = lookup(key);
+        return entry == std::string_view::npos ? m_entries.end() : m_entries.begin() + static_cast<std::ptrdiff_t>(entry);
     }
 
-    JsonObject& JsonObject::operator[](int index)
+    JsonDict::const_iterator JsonDict::find(std::string_view key) const
     {
-        if (m_type != Array)
-        {
-            throw std::runtime_error("Invalid type, wanted Array");
-        }
-        if (size() < index) {
-            throw std::runtime_error("Index out of bounds: " + std::to_string(index));
-        }
-        return asArray()[index];
+        size_t entry = lookup(key);
+        return entry == std::string_view::npos ? m_entries.end() : m_entries.begin() + static_cast<std::ptrdiff_t>(entry);
     }
 
-    std::ostream& operator<<(std::ostream& o, ArrayValue& a)
+    bool JsonDict::contains(std::string_view key) const
     {
-        return o << a.format();
+        return lookup(key) != std::string_view::npos;
     }
 
-    ArrayValue& ArrayValue::operator=([[maybe_unused]] const ArrayValue& other)
+    JsonObject& JsonDict::operator[](std::string_view key)
     {
-        this->m_value = other.m_value;
-        return *this;
+        return insert_or_assign(key, JsonObject()).first->second;
     }
 
-    JsonObject& ArrayValue::operator[]([[maybe_unused]] const int index)
+    void JsonDict::append(JsonKey&& key, JsonObject&& value)
     {
-        if (index > m_value.size())
+        m_entries.emplace_back(std::move(key), std::move(value));
+        if (m_entries.size() * 2 > m_index.size())
         {
-            throw std::runtime_error("Index out of bounds.");
+            rebuildIndex();
+        }
+        else
+        {
+            insertIndex(m_entries.size() - 1);
         }
-        return m_value[index];
     }
 
-    std::ostream& ArrayValue::operator<<(std::ostream& o)
+    std::pair<JsonDict::iterator, bool> JsonDict::insert_or_assign(std::string_view key, JsonObject value)
     {
-        return o << format();
+        size_t entry = lookup(key);
+        if (entry != std::string_view::npos)
+        {
+            m_entries[entry].second = std::move(value);
+            return {m_entries.begin() + static_cast<std::ptrdiff_t>(entry), false};
+        }
+        append(JsonKey(key), std::move(value));
+        return {m_entries.end() - 1, true};
     }
 
-    ArrayValue::ArrayValue(const ArrayValue& other)
+    std::pair<JsonDict::iterator, bool> JsonDict::insert_or_assign(JsonKey&& key, JsonObject value)
     {
-        *this = other;
+        size_t entry = lookup(key.view());
+        if (entry != std::string_view::npos)
+        {
+            m_entries[entry].second = std::move(value);
+            return {m_entries.begin() + static_cast<std::ptrdiff_t>(entry), false};
+        }
+        append(std::move(key), std::move(value));
+        return {m_entries.end() - 1, true};
     }
 
-    JsonArray *ArrayValue::ptr() {
-        return &m_value;
+    size_t JsonDict::erase(std::string_view key)
+    {
+        size_t entry = lookup(key);
+        if (entry == std::string_view::npos)
+        {
+            return 0;
+        }
+        m_entries.erase(m_entries.begin() + static_cast<std::ptrdiff_t>(entry));
+        rebuildIndex();
+        return 1;
     }
 
-    std::ostream& operator<<(std::ostream& o, DictValue& d)
+    void JsonDict::reserve(size_t size)
     {
-        return o << d.format();
+        m_entries.reserve(size);
     }
 
-    DictValue::DictValue(const DictValue& other)
+    void JsonDict::clear()
     {
-        *this = other;
+        m_entries.clear();
+        m_index.clear();
     }
 
-    size_t JsonObject::size()
-    {
-        if (m_type == Array)
-        {
-            auto a = asArray();
-            return a.value().size();
-        }
-        if (m_type == Dictionary)
+    // Lazy nodes
+    /// <summary>
+    /// An array or dictionary of a lazy Document, allocated from its arena. The
+    /// container is parsed by the Document's Parser when first accessed.
+    /// </summary>
+    struct LazyNode {
+        Parser* parser;
+
+        // Offset of the opening bracket in the parser's source.
+        size_t offset;
+
+        // The parsed container, once accessed.
+        JsonObject value;
+
+        const JsonObject& get()
         {
-            auto a = asDict();
-            return a.value().size();
+            if (value.type() == Null)
+            {
+                value = parser->expand(*this);
+            }
+            return value;
         }
+    };
 
-        throw std::runtime_error("No size accessor for this JSON object type.");
+    // JSON Object
+    JsonObject::JsonObject() = default;
+
+    JsonObject::JsonObject(const JsonObject& other)
+    {
+        *this = other;
     }
 
-    bool JsonObject::hasKey(const std::string &key) {
-        if (m_type != Dictionary)
-        {
-            throw std::runtime_error("JsonObject is not a Dictionary.");
-        }
-        auto d = asDict().value();
-        return d.count(key) != 0;
+    JsonObject::JsonObject(JsonObject&& other) noexcept
+    {
+        take(other);
     }
 
-    DictValue& DictValue::operator=([[maybe_unused]] const DictValue& other)
+    JsonObject::~JsonObject()
     {
-        m_value = other.m_value;
-        return *this;
+        release();
     }
 
-    JsonObject& DictValue::operator[](const std::string& key)
+    JsonObject::JsonObject(bool value)
     {
-        return m_value[key];
+        store(value);
+        m_type = Bool;
     }
 
-    JsonDict *DictValue::ptr() {
-        return &m_value;
+    JsonObject::JsonObject(int value)
+    {
+        store(static_cast<std::int64_t>(value));
+        m_type = Int;
     }
 
-    std::ostream& operator<<(std::ostream& o, JsonObject& j)
+    JsonObject::JsonObject(std::int64_t value)
     {
-        return o << j.format();
+        store(value);
+        m_type = Int;
     }
 
-    std::ostream& operator<<(std::ostream& o, const JsonObject& j)
+    JsonObject::JsonObject(std::uint64_t value)
     {
-        return o << j.format();
+        store(value);
+        m_type = value > static_cast<std::uint64_t>(INT64_MAX) ? UInt : Int;
     }
 
+    JsonObject::JsonObject(double value)
+    {
+        store(value);
+        m_type = Double;
+    }
 
-    JsonObject::operator bool() const {
-        if (m_type != Bool) {
-            throw std::runtime_error("Cannot implicitly convert to bool.");
-        }
-        return asBool().value();
+    JsonObject::JsonObject(const std::string& value)
+    {
+        setString(value);
     }
 
-    JsonObject::operator int() const {
-        if (m_type != Int) {
-            throw std::runtime_error("Cannot implicitly convert to int.");
+    JsonObject::JsonObject(std::string&& value)
+    {
+        if (value.size() <= SMALL_STRING_SIZE)
+        {
+            setString(value);
+            return;
         }
-        return asInt().value();
+        store(new std::string(std::move(value)));
+        m_size = HEAP_STRING;
+        m_type = EValueType::String;
     }
 
-    JsonObject::operator double() const {
-        if (m_type != Double) {
-            throw std::runtime_error("Cannot implicitly convert to double.");
-        }
-        return asDouble().value();
+    JsonObject::JsonObject(const JsonArray& value)
+    {
+        store(new ArrayValue(value));
+        m_type = Array;
     }
 
-    JsonObject::operator std::string() const {
-        if (m_type != String) {
-            throw std::runtime_error("Cannot implicitly convert to std::string.");
-        }
-        return asString().value();
+    JsonObject::JsonObject(JsonArray&& value)
+    {
+        store(new ArrayValue(std::move(value)));
+        m_type = Array;
     }
 
-    JsonObject::operator JsonArray() const {
-        if (m_type != Array) {
-            throw std::runtime_error("Cannot implicitly convert to JsonArray.");
-        }
-        return asArray().value();
+    JsonObject::JsonObject(const JsonDict& value)
+    {
+        store(new DictValue(value));
+        m_type = Dictionary;
     }
 
-    JsonObject::operator JsonDict() const {
-        if (m_type != Dictionary) {
-            throw std::runtime_error("Cannot implicitly convert to JsonDict.");
-        }
-        return asDict().value();
+    JsonObject::JsonObject(JsonDict&& value)
+    {
+        store(new DictValue(std::move(value)));
+        m_type = Dictionary;
     }
 
-    JsonObject loadFile(const std::string& filename)
+    void JsonObject::setString(std::string_view value)
     {
-        // Read file contents
-        std::ifstream file(filename); // Loading file as input stream
-        std::string data;
-        if (file)
+        if (value.size() <= SMALL_STRING_SIZE)
         {
-            std::ostringstream stream; // New stream
-            stream << file.rdbuf();    // Reading data
-            data = stream.str();       // Put stream to data string
+            std::memcpy(m_data, value.data(), value.size());
+            m_size = static_cast<std::uint8_t>(value.size());
         }
         else
         {
-            throw std::runtime_error("File not found: " + filename);
+            store(new std::string(value));
+            m_size = HEAP_STRING;
         }
-
-        // Tokenize string
-        auto* l = new Lexer(data);
-
-        // Parse string into JSON object
-        auto* p = new Parser(l);
-        return p->get();
-    }
-
-    JsonObject loadString(std::string& string)
-    {
-        // Tokenize string
-        auto* l = new Lexer(string);
-
-        // Parse string into JSON object
-        auto* p = new Parser(l);
-        return p->get();
+        m_type = EValueType::String;
     }
 
-    // Lexer
-    std::string Lexer::sanitize(std::string& input)
+    void JsonObject::release()
     {
-        std::string output;
-
-        // Whether we're inside a string or not at the current character
-        bool inString = false;
-
-        // For every character in the input string...
-        for (char& c : input)
+        switch (m_type)
+        {
+        case (String):
         {
-            // Remove new lines and end of lines
-            if (c == '\n' || c == '\0')
+            if (m_size == HEAP_STRING)
             {
-                continue;
+                delete load<std::string*>();
             }
-
-            // Remove spaces ONLY when outside a string
-            if (c == ' ' && !inString)
+            break;
+        }
+        case (Array):
+        {
+            if (m_size != BORROWED && m_size != LAZY)
             {
-                continue;
+                delete load<ArrayValue*>();
             }
-
-            // Flip-flop context of in or outside a string
-            if (c == '"')
+            break;
+        }
+        case (Dictionary):
+        {
+            if (m_size != BORROWED && m_size != LAZY)
             {
-                inString = !inString;
+                delete load<DictValue*>();
             }
-
-            // Append current character to sanitized output
-            output += c;
+            break;
         }
-
-        return output;
+        default:
+        {
+            break;
+        }
+        }
+        m_size = 0;
+        m_type = EValueType::Null;
     }
 
-    Lexer::Lexer(std::string string)
+    JsonObject JsonObject::makeString(std::string_view value, std::pmr::memory_resource* arena)
     {
-        // Sanitize input string
-        m_string = sanitize(string);
-
-        // While we are able to continue, keep going to the next token
-        while (canContinue())
+        JsonObject object;
+        if (arena == nullptr || value.size() <= SMALL_STRING_SIZE)
         {
-            // Get next token
-            Token t = next();
-
-            // TODO: Figure out why type is sometimes invalid.
-            // This is a catch-all for invalid enum values.
-            if (t.type < 0)
-            {
-                continue;
-            }
-
-            // Add to token array.
-            tokens.push_back(t);
+            object.setString(value);
+            return object;
+        }
+        if (value.size() > UINT32_MAX)
+        {
+            throw std::runtime_error("String too long: " + std::to_string(value.size()) + " bytes");
         }
+        auto* chars = static_cast<char*>(arena->allocate(value.size(), 1));
+        std::memcpy(chars, value.data(), value.size());
+        object.store<const char*>(chars);
+        object.store(static_cast<std::uint32_t>(value.size()), sizeof(char*));
+        object.m_size = BORROWED;
+        object.m_type = EValueType::String;
+        return object;
     }
 
-    bool Lexer::canContinue()
+    JsonObject JsonObject::makeStringView(std::string_view value)
     {
-        return m_offset < m_string.size();
+        JsonObject object;
+        if (value.size() <= SMALL_STRING_SIZE || value.size() > UINT32_MAX)
+        {
+            object.setString(value);
+            return object;
+        }
+        object.store(value.data());
+        object.store(static_cast<std::uint32_t>(value.size()), sizeof(char*));
+        object.m_size = BORROWED;
+        object.m_type = EValueType::String;
+        return object;
     }
 
-    Token Lexer::next()
+    JsonObject JsonObject::makeArray(JsonArray&& value, std::pmr::memory_resource* arena)
     {
-        Token token;
-
-        // Numbers
-        if (IS_NUMBER(m_string[m_offset]))
+        if (arena == nullptr)
         {
-            std::string number;
-            while (IS_NUMBER(m_string[m_offset]))
-            {
-                number += m_string[m_offset];
-                m_offset++;
-            }
-
-            token.type = EValueType::Number;
-            token.value = number;
-            return token;
+            return JsonObject(std::move(value));
         }
+        JsonObject object;
+        void* memory = arena->allocate(sizeof(ArrayValue), alignof(ArrayValue));
+        object.store(new (memory) ArrayValue(std::move(value)));
+        object.m_size = BORROWED;
+        object.m_type = Array;
+        return object;
+    }
 
-        // Strings
-        if (IS_QUOTE(m_string[m_offset]))
+    JsonObject JsonObject::makeDict(JsonDict&& value, std::pmr::memory_resource* arena)
+    {
+        if (arena == nullptr)
         {
-            std::string string;
-
-            // Skip entry quote
-            m_offset++;
+            return JsonObject(std::move(value));
+        }
+        JsonObject object;
+        void* memory = arena->allocate(sizeof(DictValue), alignof(DictValue));
+        object.store(new (memory) DictValue(std::move(value)));
+        object.m_size = BORROWED;
+        object.m_type = Dictionary;
+        return object;
+    }
 
-            // Build the string from contents inside the quotes
-            while (IS_NOT_QUOTE(m_string[m_offset]))
-            {
-                string += m_string[m_offset];
-                m_offset++;
-            }
+    JsonObject JsonObject::makeLazy(EValueType type, LazyNode* node)
+    {
+        JsonObject object;
+        object.store(node);
+        object.m_size = LAZY;
+        object.m_type = type;
+        return object;
+    }
 
-            // Skip exit quote
-            m_offset++;
-            token.type = EValueType::String;
-            token.value = string;
-            return token;
-        }
+    void JsonObject::take(JsonObject& other) noexcept
+    {
+        std::memcpy(m_data, other.m_data, sizeof(m_data));
+        m_size = other.m_size;
+        m_type = other.m_type;
+        other.m_size = 0;
+        other.m_type = EValueType::Null;
+    }
 
-        // Booleans
-        if (m_string.substr(m_offset, 4) == "true")
+    ArrayValue& JsonObject::asArray() const
+    {
+        if (m_type != Array)
         {
-            m_offset += 4;
-            token.type = EValueType::Bool;
-            token.value = "true";
-            return token;
+            throw std::runtime_error("Invalid type, wanted Array");
         }
-        if (m_string.substr(m_offset, 5) == "false")
+        if (m_size == LAZY)
         {
-            m_offset += 5;
-            token.type = EValueType::Bool;
-            token.value = "false";
-            return token;
+            return load<LazyNode*>()->get().asArray();
+        }
+        return *load<ArrayValue*>();
+    }
+
+    DictValue& JsonObject::asDict() const
+    {
+        if (m_type != Dictionary)
+        {
+            throw std::runtime_error("Invalid type, wanted Dictionary");
+        }
+        if (m_size == LAZY)
+        {
+            return load<LazyNode*>()->get().asDict();
+        }
+        return *load<DictValue*>();
+    }
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+    void JsonObject::expandLazy() const
+    {
+        if (m_size != LAZY)
+        {
+            return;
+        }
+        if (m_type == Array)
+        {
+            for (const JsonObject& element : asArray().ref())
+            {
+                element.expandLazy();
+            }
+        }
+        else
+        {
+            for (const auto& [key, value] : asDict().ref())
+            {
+                value.expandLazy();
+            }
+        }
+    }
+
+#pragma clang diagnostic pop
+
+    bool JsonObject::getBool() const
+    {
+        if (m_type != Bool)
+        {
+            throw std::runtime_error("Invalid type, wanted Bool");
+        }
+        return load<bool>();
+    }
+
+    int JsonObject::getInt() const
+    {
+        std::int64_t value = getInt64();
+        if (value < INT_MIN || value > INT_MAX)
+        {
+            throw std::out_of_range("Int value does not fit in int: " + std::to_string(value));
+        }
+        return static_cast<int>(value);
+    }
+
+    std::int64_t JsonObject::getInt64() const
+    {
+        if (m_type == UInt)
+        {
+            throw std::out_of_range("UInt value does not fit in int64: " + std::to_string(load<std::uint64_t>()));
+        }
+        if (m_type != Int)
+        {
+            throw std::runtime_error("Invalid type, wanted Int");
+        }
+        return load<std::int64_t>();
+    }
+
+    std::uint64_t JsonObject::getUInt64() const
+    {
+        if (m_type == Int)
+        {
+            std::int64_t value = load<std::int64_t>();
+            if (value < 0)
+            {
+                throw std::out_of_range("Int value does not fit in uint64: " + std::to_string(value));
+            }
+            return static_cast<std::uint64_t>(value);
+        }
+        if (m_type != UInt)
+        {
+            throw std::runtime_error("Invalid type, wanted UInt");
+        }
+        return load<std::uint64_t>();
+    }
+
+    double JsonObject::getDouble() const
+    {
+        if (m_type != Double)
+        {
+            throw std::runtime_error("Invalid type, wanted Double");
+        }
+        return load<double>();
+    }
+
+    std::string JsonObject::getString() const
+    {
+        return std::string(getStringView());
+    }
+
+    JsonArray JsonObject::getArray() const
+    {
+        return asArray().value();
+    }
+
+    JsonDict JsonObject::getDict() const
+    {
+        return asDict().value();
+    }
+
+    std::string_view JsonObject::getStringView() const
+    {
+        if (m_type != String)
+        {
+            throw std::runtime_error("Invalid type, wanted String");
+        }
+        if (m_size == HEAP_STRING)
+        {
+            return *load<std::string*>();
+        }
+        if (m_size == BORROWED)
+        {
+            return {load<const char*>(), load<std::uint32_t>(sizeof(char*))};
+        }
+        return {m_data, m_size};
+    }
+
+    const JsonArray& JsonObject::getArrayRef() const
+    {
+        return asArray().ref();
+    }
+
+    std::span<const JsonObject> JsonObject::getArraySpan() const
+    {
+        return getArrayRef();
+    }
+
+    const JsonDict& JsonObject::getDictRef() const
+    {
+        return asDict().ref();
+    }
+
+    std::string JsonObject::format() const
+    {
+        return format(FormatOptions());
+    }
+
+    std::string JsonObject::format(const FormatOptions& options) const
+    {
+        std::string string;
+        Writer(string, options).write(*this);
+        return string;
+    }
+
+    std::string JsonObject::format(const FormatOptions& options, [[maybe_unused]] ParseStats& stats) const
+    {
+        std::string string;
+        {
+            JSON_TIME(stats.formatNs);
+            Writer(string, options).write(*this);
+        }
+#if JSON_ENABLE_STATS == true
+        stats.formattedBytes += string.size();
+#endif
+        return string;
+    }
+
+    JsonObject& JsonObject::operator=(const JsonObject& other)
+    {
+        if (this == &other)
+        {
+            return *this;
+        }
+        switch (other.m_type)
+        {
+        case (String):
+        {
+            if (other.m_size == HEAP_STRING || other.m_size == BORROWED)
+            {
+                JsonObject copy;
+                copy.setString(other.getStringView());
+                release();
+                take(copy);
+                return *this;
+            }
+            break;
+        }
+        case (Array):
+        {
+            auto* array = new ArrayValue(other.asArray());
+            release();
+            store(array);
+            m_type = Array;
+            return *this;
+        }
+        case (Dictionary):
+        {
+            auto* dict = new DictValue(other.asDict());
+            release();
+            store(dict);
+            m_type = Dictionary;
+            return *this;
+        }
+        default:
+        {
+            break;
+        }
+        }
+
+        // Inline values are copied as-is
+        release();
+        std::memcpy(m_data, other.m_data, sizeof(m_data));
+        m_size = other.m_size;
+        m_type = other.m_type;
+        return *this;
+    }
+
+    JsonObject& JsonObject::operator=(JsonObject&& other) noexcept
+    {
+        if (this != &other)
+        {
+            // Steal first, in case `other` lives inside the payload we release
+            JsonObject value;
+            value.take(other);
+            release();
+            take(value);
+        }
+        return *this;
+    }
+
+    const JsonObject* JsonObject::find(std::string_view key) const
+    {
+        if (m_type != Dictionary)
+        {
+            throw std::runtime_error("Invalid type, wanted Dictionary");
+        }
+        const JsonDict& dict = asDict().ref();
+        auto it = dict.find(key);
+        return it != dict.end() ? &it->second : nullptr;
+    }
+
+    JsonObject* JsonObject::find(std::string_view key)
+    {
+        return const_cast<JsonObject*>(std::as_const(*this).find(key));
+    }
+
+    JsonObject& JsonObject::operator[](std::string_view key)
+    {
+        return const_cast<JsonObject&>(std::as_const(*this)[key]);
+    }
+
+    const JsonObject& JsonObject::operator[](std::string_view key) const
+    {
+        const JsonObject* value = find(key);
+        if (value == nullptr) {
+            throw std::runtime_error("Missing key: " + std::string(key));
+        }
+        return *value;
+    }
+
+    JsonObject& JsonObject::operator[](int index)
+    {
+        return const_cast<JsonObject&>(std::as_const(*this)[index]);
+    }
+
+    const JsonObject& JsonObject::operator[](int index) const
+    {
+        if (m_type != Array)
+        {
+            throw std::runtime_error("Invalid type, wanted Array");
+        }
+        const JsonArray& array = asArray().ref();
+        if (index < 0 || static_cast<size_t>(index) >= array.size()) {
+            throw std::runtime_error("Index out of bounds: " + std::to_string(index));
+        }
+        return array[index];
+    }
+
+    std::ostream& operator<<(std::ostream& o, ArrayValue& a)
+    {
+        return o << a.format();
+    }
+
+    ArrayValue& ArrayValue::operator=([[maybe_unused]] const ArrayValue& other)
+    {
+        this->m_value = other.m_value;
+        return *this;
+    }
+
+    ArrayValue& ArrayValue::operator=(ArrayValue&& other) noexcept
+    {
+        this->m_value = std::move(other.m_value);
+        return *this;
+    }
+
+    JsonObject& ArrayValue::operator[]([[maybe_unused]] const int index)
+    {
+        if (index < 0 || static_cast<size_t>(index) >= m_value.size())
+        {
+            throw std::runtime_error("Index out of bounds.");
+        }
+        return m_value[index];
+    }
+
+    std::ostream& ArrayValue::operator<<(std::ostream& o)
+    {
+        return o << format();
+    }
+
+    ArrayValue::ArrayValue(const ArrayValue& other)
+    {
+        *this = other;
+    }
+
+    ArrayValue::ArrayValue(ArrayValue&& other) noexcept : m_value(std::move(other.m_value))
+    {
+    }
+
+    JsonArray *ArrayValue::ptr() {
+        return &m_value;
+    }
+
+    std::ostream& operator<<(std::ostream& o, DictValue& d)
+    {
+        return o << d.format();
+    }
+
+    DictValue::DictValue(const DictValue& other)
+    {
+        *this = other;
+    }
+
+    DictValue::DictValue(DictValue&& other) noexcept : m_value(std::move(other.m_value))
+    {
+    }
+
+    size_t JsonObject::size() const
+    {
+        if (m_type == Array)
+        {
+            return asArray().ref().size();
+        }
+        if (m_type == Dictionary)
+        {
+            return asDict().ref().size();
+        }
+
+        throw std::runtime_error("No size accessor for this JSON object type.");
+    }
+
+    bool JsonObject::hasKey(std::string_view key) const {
+        if (m_type != Dictionary)
+        {
+            throw std::runtime_error("JsonObject is not a Dictionary.");
+        }
+        return asDict().ref().contains(key);
+    }
+
+    DictValue& DictValue::operator=([[maybe_unused]] const DictValue& other)
+    {
+        m_value = other.m_value;
+        return *this;
+    }
+
+    DictValue& DictValue::operator=(DictValue&& other) noexcept
+    {
+        m_value = std::move(other.m_value);
+        return *this;
+    }
+
+    JsonObject& DictValue::operator[](std::string_view key)
+    {
+        return m_value[key];
+    }
+
+    JsonDict *DictValue::ptr() {
+        return &m_value;
+    }
+
+    std::ostream& operator<<(std::ostream& o, JsonObject& j)
+    {
+        Writer(o).write(j);
+        return o;
+    }
+
+    std::ostream& operator<<(std::ostream& o, const JsonObject& j)
+    {
+        Writer(o).write(j);
+        return o;
+    }
+
+
+    JsonObject::operator bool() const {
+        if (m_type != Bool) {
+            throw std::runtime_error("Cannot implicitly convert to bool.");
+        }
+        return getBool();
+    }
+
+    JsonObject::operator int() const {
+        if (m_type != Int) {
+            throw std::runtime_error("Cannot implicitly convert to int.");
+        }
+        return getInt();
+    }
+
+    JsonObject::operator std::int64_t() const {
+        if (m_type != Int) {
+            throw std::runtime_error("Cannot implicitly convert to int64_t.");
+        }
+        return getInt64();
+    }
+
+    JsonObject::operator std::uint64_t() const {
+        if (m_type != Int && m_type != UInt) {
+            throw std::runtime_error("Cannot implicitly convert to uint64_t.");
+        }
+        return getUInt64();
+    }
+
+    JsonObject::operator double() const {
+        if (m_type != Double) {
+            throw std::runtime_error("Cannot implicitly convert to double.");
+        }
+        return getDouble();
+    }
+
+    JsonObject::operator std::string() const {
+        if (m_type != String) {
+            throw std::runtime_error("Cannot implicitly convert to std::string.");
+        }
+        return getString();
+    }
+
+    JsonObject::operator std::string_view() const {
+        if (m_type != String) {
+            throw std::runtime_error("Cannot implicitly convert to std::string_view.");
+        }
+        return getStringView();
+    }
+
+    JsonObject::operator JsonArray() const {
+        if (m_type != Array) {
+            throw std::runtime_error("Cannot implicitly convert to JsonArray.");
+        }
+        return asArray().value();
+    }
+
+    JsonObject::operator JsonDict() const {
+        if (m_type != Dictionary) {
+            throw std::runtime_error("Cannot implicitly convert to JsonDict.");
+        }
+        return asDict().value();
+    }
+
+    JsonObject loadFile(const std::string& filename)
+    {
+        MappedFile file(filename);
+
+        // Parse the file's contents into JSON object
+        Parser parser;
+        return std::move(parser.parse(file.view()));
+    }
+
+    JsonObject loadString(std::string& string)
+    {
+        // Parse string into JSON object
+        Parser parser;
+        return std::move(parser.parse(string));
+    }
+
+    const JsonObject& loadFile(const std::string& filename, Document& document, EParseMode mode)
+    {
+        return document.parseFile(filename, mode);
+    }
+
+    const JsonObject& loadFile(const std::string& filename, Document& document, ParseStats& stats)
+    {
+        return document.parseFile(filename, stats);
+    }
+
+    // Numbers
+    JsonObject parseNumber(std::string_view text)
+    {
+        const char* begin = text.data();
+        const char* end = begin + text.size();
+        const char* p = begin;
+        bool negative = false;
+        bool integer = true;
+
+        // Validate against the JSON number grammar:
+        // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+        if (p != end && *p == '-')
+        {
+            negative = true;
+            p++;
+        }
+        if (p == end || !std::isdigit(static_cast<unsigned char>(*p)) ||
+            (*p == '0' && p + 1 != end && std::isdigit(static_cast<unsigned char>(p[1]))))
+        {
+            throw std::runtime_error("Invalid number: " + std::string(text));
+        }
+        // Decimal exponent of the first significant digit, which tells
+        // underflow from overflow when the value is out of range
+        bool significant = *p != '0';
+        std::int64_t magnitude = -1;
+        while (p != end && std::isdigit(static_cast<unsigned char>(*p)))
+        {
+            magnitude += significant;
+            p++;
+        }
+        if (p != end && *p == '.')
+        {
+            integer = false;
+            if (++p == end || !std::isdigit(static_cast<unsigned char>(*p)))
+            {
+                throw std::runtime_error("Invalid number: " + std::string(text));
+            }
+            while (p != end && std::isdigit(static_cast<unsigned char>(*p)))
+            {
+                // Leading zeros of a fraction move the first significant digit
+                // one place further down
+                if (!significant)
+                {
+                    significant = *p != '0';
+                    magnitude -= !significant;
+                }
+                p++;
+            }
+        }
+        if (p != end && (*p == 'e' || *p == 'E'))
+        {
+            integer = false;
+            bool negativeExponent = false;
+            if (++p != end && (*p == '+' || *p == '-'))
+            {
+                negativeExponent = *p == '-';
+                p++;
+            }
+            if (p == end || !std::isdigit(static_cast<unsigned char>(*p)))
+            {
+                throw std::runtime_error("Invalid number: " + std::string(text));
+            }
+            std::int64_t exponent = 0;
+            while (p != end && std::isdigit(static_cast<unsigned char>(*p)))
+            {
+                // Anything this large is out of range either way
+                exponent = std::min<std::int64_t>(exponent * 10 + (*p - '0'), 1'000'000'000);
+                p++;
+            }
+            magnitude += negativeExponent ? -exponent : exponent;
+        }
+        if (p != end)
+        {
+            throw std::runtime_error("Invalid number: " + std::string(text));
+        }
+
+        // Integers which fit in 64 bits
+        if (integer)
+        {
+            if (negative)
+            {
+                std::int64_t value;
+                if (std::from_chars(begin, end, value).ec == std::errc())
+                {
+                    return JsonObject(value);
+                }
+            }
+            else
+            {
+                std::uint64_t value;
+                if (std::from_chars(begin, end, value).ec == std::errc())
+                {
+                    return JsonObject(value);
+                }
+            }
+        }
+
+        // Everything else is a double
+        double value;
+        if (std::from_chars(begin, end, value).ec == std::errc::result_out_of_range)
+        {
+            // Underflow (a value below one) rounds to zero; overflow can't be
+            // represented
+            if (magnitude >= 0)
+            {
+                throw std::out_of_range("Number out of range: " + std::string(text));
+            }
+            value = negative ? -0.0 : 0.0;
+        }
+        return JsonObject(value);
+    }
+
+    // Strings
+    /// <summary>
+    /// Reads the four hex digits of a \u escape at `offset` in `text`.
+    /// </summary>
+    static std::uint32_t readHex4(std::string_view text, size_t offset)
+    {
+        std::uint32_t value = 0;
+        const char* begin = text.data() + offset;
+        if (text.size() < offset + 4 || std::from_chars(begin, begin + 4, value, 16).ptr != begin + 4)
+        {
+            throw std::runtime_error("Invalid \\u escape in string: " + std::string(text));
+        }
+        return value;
+    }
+
+    std::string_view unescapeString(std::string_view text, std::string& scratch)
+    {
+        size_t backslash = text.find('\\');
+        if (backslash == std::string_view::npos)
+        {
+            return text;
+        }
+
+        // Copy the runs between escapes, decoding each escape
+        scratch.assign(text.data(), backslash);
+        size_t offset = backslash;
+        while (backslash != std::string_view::npos)
+        {
+            scratch.append(text.substr(offset, backslash - offset));
+            if (backslash + 1 == text.size())
+            {
+                throw std::runtime_error("Invalid escape in string: " + std::string(text));
+            }
+            offset = backslash + 2;
+            switch (text[backslash + 1])
+            {
+            case ('"'): scratch.push_back('"'); break;
+            case ('\\'): scratch.push_back('\\'); break;
+            case ('/'): scratch.push_back('/'); break;
+            case ('b'): scratch.push_back('\b'); break;
+            case ('f'): scratch.push_back('\f'); break;
+            case ('n'): scratch.push_back('\n'); break;
+            case ('r'): scratch.push_back('\r'); break;
+            case ('t'): scratch.push_back('\t'); break;
+            case ('u'):
+            {
+                std::uint32_t code = readHex4(text, offset);
+                offset += 4;
+
+                // Characters beyond the basic plane are written as a surrogate pair
+                if (code >= 0xD800 && code <= 0xDBFF && text.substr(offset, 2) == "\\u")
+                {
+                    std::uint32_t low = readHex4(text, offset + 2);
+                    if (low >= 0xDC00 && low <= 0xDFFF)
+                    {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        offset += 6;
+                    }
+                }
+                if (code >= 0xD800 && code <= 0xDFFF)
+                {
+                    throw std::runtime_error("Unpaired surrogate in string: " + std::string(text));
+                }
+
+                // Encode as UTF-8
+                if (code < 0x80)
+                {
+                    scratch.push_back(static_cast<char>(code));
+                }
+                else if (code < 0x800)
+                {
+                    scratch.push_back(static_cast<char>(0xC0 | (code >> 6)));
+                    scratch.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                }
+                else if (code < 0x10000)
+                {
+                    scratch.push_back(static_cast<char>(0xE0 | (code >> 12)));
+                    scratch.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                    scratch.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                }
+                else
+                {
+                    scratch.push_back(static_cast<char>(0xF0 | (code >> 18)));
+                    scratch.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+                    scratch.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                    scratch.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                }
+                break;
+            }
+            default:
+            {
+                throw std::runtime_error("Invalid escape '\\" + std::string(1, text[backslash + 1]) +
+                                         "' in string: " + std::string(text));
+            }
+            }
+            backslash = text.find('\\', offset);
+        }
+        scratch.append(text.substr(offset));
+        return scratch;
+    }
+
+    // Mapped file
+    MappedFile::MappedFile(const std::string& filename)
+    {
+#if JSON_HAS_MMAP == true
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("File not found: " + filename);
+        }
+        struct stat info{};
+        if (::fstat(fd, &info) == 0 && S_ISDIR(info.st_mode))
+        {
+            ::close(fd);
+            throw std::runtime_error("Not a file: " + filename);
+        }
+        if (S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            void* data = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                ::madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+                m_data = static_cast<const char*>(data);
+                m_size = static_cast<size_t>(info.st_size);
+                m_mapped = true;
+                ::close(fd);
+                return;
+            }
+        }
+
+        // Pipes, devices and /proc files have no size up front (or a wrong
+        // one), so read them until the end from the descriptor already open
+        size_t size = 0;
+        while (true)
+        {
+            if (size == m_buffer.size())
+            {
+                m_buffer.resize(std::max<size_t>(size * 2, 64 * 1024));
+            }
+            ssize_t count = ::read(fd, m_buffer.data() + size, m_buffer.size() - size);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count < 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("Unable to read: " + filename);
+            }
+            if (count == 0)
+            {
+                break;
+            }
+            size += static_cast<size_t>(count);
+        }
+        ::close(fd);
+        m_buffer.resize(size);
+#else
+        // Read file contents
+        std::ifstream file(filename, std::ios::binary); // Loading file as input stream
+        if (!file)
+        {
+            throw std::runtime_error("File not found: " + filename);
+        }
+        std::ostringstream stream; // New stream
+        stream << file.rdbuf();    // Reading data
+        m_buffer = std::move(stream).str();
+#endif
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            m_buffer = std::move(other.m_buffer);
+            m_data = other.m_mapped ? other.m_data : m_buffer.data();
+            m_size = other.m_size;
+            m_mapped = other.m_mapped;
+            other.m_data = nullptr;
+            other.m_size = 0;
+            other.m_mapped = false;
+        }
+        return *this;
+    }
+
+    std::string_view MappedFile::view() const
+    {
+        return {m_data, m_size};
+    }
+
+    void MappedFile::close()
+    {
+#if JSON_HAS_MMAP == true
+        if (m_mapped)
+        {
+            ::munmap(const_cast<char*>(m_data), m_size);
+        }
+#endif
+        m_buffer.clear();
+        m_buffer.shrink_to_fit();
+        m_data = nullptr;
+        m_size = 0;
+        m_mapped = false;
+    }
+
+    const JsonObject& loadString(std::string_view string, Document& document, EParseMode mode)
+    {
+        return document.parse(string, mode);
+    }
+
+    const JsonObject& loadString(std::string_view string, Document& document, ParseStats& stats)
+    {
+        return document.parse(string, stats);
+    }
+
+    // Document
+#if JSON_ENABLE_STATS == true
+    Document::Document(size_t initialSize) : m_arena(initialSize, &m_upstream)
+    {
+    }
+#else
+    Document::Document(size_t initialSize) : m_arena(initialSize)
+    {
+    }
+#endif
+
+    const JsonObject& Document::parse(std::string_view string, EParseMode mode)
+    {
+        if (mode == Lazy)
+        {
+            // The tree is parsed as it is accessed, so it needs its own copy of
+            // the source; long strings can then borrow from it
+            clear();
+            auto* copy = static_cast<char*>(m_arena.allocate(std::max<size_t>(string.size(), 1), 1));
+            std::memcpy(copy, string.data(), string.size());
+            m_root = std::move(m_parser.parseLazy({copy, string.size()}, &m_arena, true));
+            return m_root;
+        }
+        if (mode == Parallel)
+        {
+            clear();
+            m_root = std::move(m_parser.parseParallel(string, &m_arena, false, ThreadPool::shared(), m_arenas));
+            return m_root;
+        }
+        Parser parser;
+        return parse(string, parser);
+    }
+
+    const JsonObject& Document::parse(std::string_view string, Parser& parser)
+    {
+        clear();
+        m_root = std::move(parser.parse(string, &m_arena));
+        return m_root;
+    }
+
+    const JsonObject& Document::parseFile(const std::string& filename, EParseMode mode)
+    {
+        if (mode == Lazy)
+        {
+            clear();
+            m_file = MappedFile(filename);
+            m_root = std::move(m_parser.parseLazy(m_file.view(), &m_arena, true));
+            return m_root;
+        }
+        if (mode == Parallel)
+        {
+            clear();
+            m_file = MappedFile(filename);
+            m_root = std::move(m_parser.parseParallel(m_file.view(), &m_arena, true, ThreadPool::shared(), m_arenas));
+            return m_root;
+        }
+        Parser parser;
+        return parseFile(filename, parser);
+    }
+
+    const JsonObject& Document::parseFile(const std::string& filename, Parser& parser)
+    {
+        clear();
+        m_file = MappedFile(filename);
+        m_root = std::move(parser.parse(m_file.view(), &m_arena, true));
+        return m_root;
+    }
+
+    const JsonObject& Document::parse(std::string_view string, ParseStats& stats)
+    {
+        clear();
+        return parseCounted(string, false, stats);
+    }
+
+    const JsonObject& Document::parseFile(const std::string& filename, ParseStats& stats)
+    {
+        clear();
+        {
+            JSON_TIME(stats.readNs);
+            m_file = MappedFile(filename);
+        }
+        return parseCounted(m_file.view(), true, stats);
+    }
+
+    const JsonObject& Document::parseCounted(std::string_view string, bool borrow, [[maybe_unused]] ParseStats& stats)
+    {
+#if JSON_ENABLE_STATS == true
+        stats.bytes += string.size();
+        m_upstream.setStats(&stats);
+        m_parser.setStats(&stats);
+        try
+        {
+            JSON_TIME(stats.parseNs);
+            m_root = std::move(m_parser.parse(string, &m_arena, borrow));
+        }
+        catch (...)
+        {
+            m_upstream.setStats(nullptr);
+            m_parser.setStats(nullptr);
+            throw;
+        }
+        m_upstream.setStats(nullptr);
+        m_parser.setStats(nullptr);
+#else
+        m_root = std::move(m_parser.parse(string, &m_arena, borrow));
+#endif
+        return m_root;
+    }
+
+    const JsonObject& Document::root() const
+    {
+        return m_root;
+    }
+
+    void Document::clear()
+    {
+        // The tree borrows everything from the arena, so dropping it is free
+        m_root = JsonObject();
+        m_parser.reset();
+        m_arena.release();
+        m_arenas.clear();
+        m_file.close();
+    }
+
+    // Block classification
+    static void classifyScalar(const char* block, BlockMasks& masks)
+    {
+        masks = BlockMasks();
+        for (int i = 0; i < 64; i++)
+        {
+            char c = block[i];
+            std::uint64_t bit = std::uint64_t(1) << i;
+            if (IS_QUOTE(c))
+            {
+                masks.quote |= bit;
+            }
+            else if (IS_BACKSLASH(c))
+            {
+                masks.backslash |= bit;
+            }
+            else if (IS_WHITESPACE(c))
+            {
+                masks.whitespace |= bit;
+            }
+            else if (IS_LBRACE(c) || IS_LBRACKET(c))
+            {
+                masks.structural |= bit;
+                masks.open |= bit;
+            }
+            else if (IS_RBRACE(c) || IS_RBRACKET(c))
+            {
+                masks.structural |= bit;
+                masks.close |= bit;
+            }
+            else if (IS_COMMA(c) || IS_COLON(c))
+            {
+                masks.structural |= bit;
+            }
+        }
+    }
+
+#if JSON_HAS_X86_SIMD == true
+    __attribute__((target("sse4.2"))) static inline std::uint64_t matchSse42(__m128i v, char c)
+    {
+        return static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c))));
+    }
+
+    __attribute__((target("sse4.2"))) static void classifySse42(const char* block, BlockMasks& masks)
+    {
+        masks = BlockMasks();
+        for (int i = 0; i < 64; i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i));
+            masks.quote |= matchSse42(v, '"') << i;
+            masks.backslash |= matchSse42(v, '\\') << i;
+            masks.whitespace |= (matchSse42(v, ' ') | matchSse42(v, '\n') | matchSse42(v, '\r') |
+                                 matchSse42(v, '\t') | matchSse42(v, '\0')) << i;
+            std::uint64_t open = matchSse42(v, '[') | matchSse42(v, '{');
+            std::uint64_t close = matchSse42(v, ']') | matchSse42(v, '}');
+            masks.open |= open << i;
+            masks.close |= close << i;
+            masks.structural |= (matchSse42(v, ',') | matchSse42(v, ':') | open | close) << i;
+        }
+    }
+
+    __attribute__((target("avx2"))) static inline std::uint64_t matchAvx2(__m256i v, char c)
+    {
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))));
+    }
+
+    __attribute__((target("avx2"))) static void classifyAvx2(const char* block, BlockMasks& masks)
+    {
+        masks = BlockMasks();
+        for (int i = 0; i < 64; i += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i));
+            masks.quote |= matchAvx2(v, '"') << i;
+            masks.backslash |= matchAvx2(v, '\\') << i;
+            masks.whitespace |= (matchAvx2(v, ' ') | matchAvx2(v, '\n') | matchAvx2(v, '\r') |
+                                 matchAvx2(v, '\t') | matchAvx2(v, '\0')) << i;
+            std::uint64_t open = matchAvx2(v, '[') | matchAvx2(v, '{');
+            std::uint64_t close = matchAvx2(v, ']') | matchAvx2(v, '}');
+            masks.open |= open << i;
+            masks.close |= close << i;
+            masks.structural |= (matchAvx2(v, ',') | matchAvx2(v, ':') | open | close) << i;
+        }
+    }
+#endif
+
+    typedef void (*ClassifyFunction)(const char*, BlockMasks&);
+
+    struct Classifier {
+        ClassifyFunction function;
+        const char* name;
+    };
+
+    static Classifier selectClassifier()
+    {
+#if JSON_HAS_X86_SIMD == true
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return {classifyAvx2, "AVX2"};
+        }
+        if (__builtin_cpu_supports("sse4.2"))
+        {
+            return {classifySse42, "SSE4.2"};
+        }
+#endif
+        return {classifyScalar, "Scalar"};
+    }
+
+    /// <summary>
+    /// Returns the classifier for this CPU, selected on first use so that
+    /// parses during the static initialisation of other files still find it.
+    /// </summary>
+    static const Classifier& classifier()
+    {
+        static const Classifier selected = selectClassifier();
+        return selected;
+    }
+
+    void classifyBlock(const char* block, BlockMasks& masks)
+    {
+        classifier().function(block, masks);
+    }
+
+    const char* classifyInstructionSet()
+    {
+        return classifier().name;
+    }
+
+    // Lexer
+    Lexer::Lexer(std::string_view string, size_t offset) : m_string(string), m_offset(offset)
+    {
+    }
+
+    std::string_view Lexer::source() const
+    {
+        return m_string;
+    }
+
+    size_t Lexer::offset() const
+    {
+        return m_offset;
+    }
+
+    /// <summary>
+    /// Returns the bits of the characters in a block which are escaped, i.e.
+    /// preceded by an odd number of backslashes. `carry` is set if the block
+    /// ends part way through an escape, and must be passed to the next block.
+    /// </summary>
+    static std::uint64_t findEscaped(std::uint64_t backslash, std::uint64_t& carry)
+    {
+        const std::uint64_t evenBits = 0x5555555555555555;
+        const std::uint64_t oddBits = ~evenBits;
+
+        // Runs of backslashes which start on even and odd bits. The carry from
+        // the previous block continues a run into bit 0.
+        std::uint64_t starts = backslash & ~(backslash << 1);
+        std::uint64_t evenStartMask = evenBits ^ carry;
+        std::uint64_t evenStarts = starts & evenStartMask;
+        std::uint64_t oddStarts = starts & ~evenStartMask;
+
+        // Adding the start of a run to the run carries out just past its end
+        std::uint64_t evenCarries = backslash + evenStarts;
+        std::uint64_t oddCarries = backslash + oddStarts;
+        bool overflow = oddCarries < backslash;
+        oddCarries |= carry;
+        carry = overflow ? 1 : 0;
+
+        // Odd length runs escape the character after them
+        std::uint64_t evenStartOddEnd = evenCarries & ~backslash & oddBits;
+        std::uint64_t oddStartEvenEnd = oddCarries & ~backslash & evenBits;
+        return evenStartOddEnd | oddStartEvenEnd;
+    }
+
+    /// <summary>
+    /// Returns a mask with each bit set if an odd number of bits at or below it
+    /// are set in `bits`.
+    /// </summary>
+    static std::uint64_t prefixXor(std::uint64_t bits)
+    {
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+    }
+
+    void Lexer::skipContainer(const Token& open)
+    {
+        // Each block is handled as a whole: escaped characters are masked out,
+        // the bits inside strings found from the quotes, and the brackets
+        // outside strings counted. Only the block where the depth may return to
+        // zero is walked a bracket at a time.
+        size_t offset = open.offset;
+        size_t depth = 0;
+        std::uint64_t escapeCarry = 0;
+        std::uint64_t inString = 0;
+        while (offset < m_string.size())
+        {
+            const BlockMasks& masks = masksAt(offset);
+            std::uint64_t valid = ~std::uint64_t(0) << (offset - m_blockOffset);
+            std::uint64_t escaped = findEscaped(masks.backslash & valid, escapeCarry);
+            std::uint64_t quotes = masks.quote & valid & ~escaped;
+            std::uint64_t strings = prefixXor(quotes) ^ inString;
+            inString = static_cast<std::uint64_t>(static_cast<std::int64_t>(strings) >> 63);
+
+            std::uint64_t opens = masks.open & valid & ~strings;
+            std::uint64_t closes = masks.close & valid & ~strings;
+            if (static_cast<size_t>(std::popcount(closes)) < depth)
+            {
+                depth += std::popcount(opens);
+                depth -= std::popcount(closes);
+                offset = m_blockOffset + 64;
+                continue;
+            }
+
+            // The container may end in this block
+            for (std::uint64_t brackets = opens | closes; brackets != 0; brackets &= brackets - 1)
+            {
+                std::uint64_t bit = brackets & -brackets;
+                if (opens & bit)
+                {
+                    depth++;
+                }
+                else if (--depth == 0)
+                {
+                    m_offset = m_blockOffset + std::countr_zero(bit) + 1;
+                    return;
+                }
+            }
+            offset = m_blockOffset + 64;
+        }
+        throw std::runtime_error("Unterminated container at offset " + std::to_string(open.offset));
+    }
+
+    ElementScan Lexer::scanElements(size_t offset, size_t end, size_t large, bool dict)
+    {
+        // Brackets and strings are found as in skipContainer. Blocks where the
+        // depth stays inside an element, and blocks of array scalars before
+        // `end`, are handled as a whole; others are walked a character at a time.
+        ElementScan scan;
+        scan.element = offset;
+        size_t depth = 0;
+        size_t child = 0;
+        std::uint64_t escapeCarry = 0;
+        std::uint64_t inString = 0;
+        while (offset < m_string.size())
+        {
+            const BlockMasks& masks = masksAt(offset);
+            std::uint64_t valid = ~std::uint64_t(0) << (offset - m_blockOffset);
+            std::uint64_t escaped = findEscaped(masks.backslash & valid, escapeCarry);
+            std::uint64_t quotes = masks.quote & valid & ~escaped;
+            std::uint64_t strings = prefixXor(quotes) ^ inString;
+            inString = static_cast<std::uint64_t>(static_cast<std::int64_t>(strings) >> 63);
+
+            std::uint64_t opens = masks.open & valid & ~strings;
+            std::uint64_t closes = masks.close & valid & ~strings;
+            std::uint64_t separators = masks.structural & valid & ~strings & ~(masks.open | masks.close);
+            size_t next = m_blockOffset + 64;
+            if (static_cast<size_t>(std::popcount(closes)) < depth)
+            {
+                depth += std::popcount(opens);
+                depth -= std::popcount(closes);
+                offset = next;
+                continue;
+            }
+            if (depth == 0 && (opens | closes) == 0 && next <= end && !dict)
+            {
+                if (separators != 0)
+                {
+                    scan.count += std::popcount(separators);
+                    scan.element = next - std::countl_zero(separators);
+                }
+                offset = next;
+                continue;
+            }
+
+            for (std::uint64_t bits = opens | closes | separators; bits != 0; bits &= bits - 1)
+            {
+                std::uint64_t bit = bits & -bits;
+                size_t position = m_blockOffset + std::countr_zero(bit);
+                if (opens & bit)
+                {
+                    if (depth++ == 0)
+                    {
+                        child = position;
+                    }
+                }
+                else if (closes & bit)
+                {
+                    if (depth == 0)
+                    {
+                        scan.count++;
+                        scan.closed = true;
+                        m_offset = position + 1;
+                        return scan;
+                    }
+                    if (--depth == 0 && position + 1 - child >= large)
+                    {
+                        scan.container = child;
+                        m_offset = position + 1;
+                        return scan;
+                    }
+                }
+                else if (depth == 0 && m_string[position] == ',')
+                {
+                    scan.count++;
+                    scan.element = position + 1;
+                    if (position >= end)
+                    {
+                        m_offset = position + 1;
+                        return scan;
+                    }
+                }
+            }
+            offset = next;
+        }
+        throw std::runtime_error("Unterminated container at offset " + std::to_string(scan.element));
+    }
+
+    const BlockMasks& Lexer::masksAt(size_t offset)
+    {
+        size_t blockOffset = offset & ~size_t(63);
+        if (blockOffset != m_blockOffset)
+        {
+            m_blockOffset = blockOffset;
+            if (blockOffset + 64 <= m_string.size())
+            {
+                classifyBlock(m_string.data() + blockOffset, m_masks);
+            }
+            else
+            {
+                // Pad the final partial block; callers never look past the end
+                char block[64] = {};
+                std::memcpy(block, m_string.data() + blockOffset, m_string.size() - blockOffset);
+                classifyBlock(block, m_masks);
+            }
+        }
+        return m_masks;
+    }
+
+    void Lexer::skipWhitespace()
+    {
+        // Most tokens are not preceded by whitespace at all
+        if (m_offset >= m_string.size() || !(IS_WHITESPACE(m_string[m_offset])))
+        {
+            return;
+        }
+
+        // Jump to the first non-whitespace character, a block at a time
+        while (m_offset < m_string.size())
+        {
+            const BlockMasks& masks = masksAt(m_offset);
+            std::uint64_t bits = ~masks.whitespace >> (m_offset - m_blockOffset);
+            if (bits != 0)
+            {
+                m_offset += std::countr_zero(bits);
+                break;
+            }
+            m_offset = m_blockOffset + 64;
+        }
+        m_offset = std::min(m_offset, m_string.size());
+    }
+
+    size_t Lexer::findQuoteOrBackslash(size_t offset)
+    {
+        while (offset < m_string.size())
+        {
+            const BlockMasks& masks = masksAt(offset);
+            std::uint64_t bits = (masks.quote | masks.backslash) >> (offset - m_blockOffset);
+            if (bits != 0)
+            {
+                return std::min(offset + std::countr_zero(bits), m_string.size());
+            }
+            offset = m_blockOffset + 64;
+        }
+        return m_string.size();
+    }
+
+    bool Lexer::canContinue()
+    {
+        skipWhitespace();
+        return m_offset < m_string.size();
+    }
+
+    std::string_view Lexer::value(const Token& token) const
+    {
+        return m_string.substr(token.offset, token.length);
+    }
+
+    Token Lexer::next()
+    {
+        Token token;
+        skipWhitespace();
+        token.offset = m_offset;
+
+        // End of input
+        if (m_offset >= m_string.size())
+        {
+            token.type = EValueType::End;
+            return token;
+        }
+        char c = m_string[m_offset];
+
+        // Separators, which are the most common tokens
+        token.length = 1;
+        if (IS_COMMA(c))
+        {
+            m_offset++;
+            token.type = EValueType::Comma;
+            return token;
+        }
+
+        if (IS_COLON(c))
+        {
+            m_offset++;
+            token.type = EValueType::Colon;
+            return token;
+        }
+
+        if (IS_LBRACE(c))
+        {
+            m_offset++;
+            token.type = EValueType::LBrace;
+            return token;
+        }
+
+        if (IS_RBRACE(c))
+        {
+            m_offset++;
+            token.type = EValueType::RBrace;
+            return token;
+        }
+
+        if (IS_LBRACKET(c))
+        {
+            m_offset++;
+            token.type = EValueType::LBracket;
+            return token;
+        }
+
+        if (IS_RBRACKET(c))
+        {
+            m_offset++;
+            token.type = EValueType::RBracket;
+            return token;
+        }
+
+        // Strings
+        if (IS_QUOTE(c))
+        {
+            // Skip entry quote
+            m_offset++;
+            token.offset = m_offset;
+
+            // Find the exit quote, jumping between quotes and backslashes and
+            // stepping over escaped characters
+            m_offset = findQuoteOrBackslash(m_offset);
+            while (m_offset < m_string.size() && IS_BACKSLASH(m_string[m_offset]))
+            {
+                m_offset = findQuoteOrBackslash(m_offset + 2);
+            }
+            if (m_offset >= m_string.size())
+            {
+                throw std::runtime_error("Unterminated string at offset " + std::to_string(token.offset - 1));
+            }
+
+            token.type = EValueType::String;
+            token.length = m_offset - token.offset;
+
+            // Skip exit quote
+            m_offset++;
+            return token;
+        }
+
+        // Numbers
+        if (IS_NUMBER(c))
+        {
+            while (m_offset < m_string.size() &&
+                   (IS_NUMBER(m_string[m_offset]) || IS_EXPONENT(m_string[m_offset])))
+            {
+                m_offset++;
+            }
+
+            token.type = EValueType::Number;
+            token.length = m_offset - token.offset;
+            return token;
+        }
+
+        // Booleans
+        if (m_string.compare(m_offset, 4, "true") == 0)
+        {
+            m_offset += 4;
+            token.type = EValueType::Bool;
+            token.length = 4;
+            return token;
+        }
+        if (m_string.compare(m_offset, 5, "false") == 0)
+        {
+            m_offset += 5;
+            token.type = EValueType::Bool;
+            token.length = 5;
+            return token;
         }
 
         // Null
-        if (m_string.substr(m_offset, 4) == "null")
+        if (m_string.compare(m_offset, 4, "null") == 0)
+        {
+            m_offset += 4;
+            token.type = EValueType::Null;
+            token.length = 4;
+            return token;
+        }
+
+        // In all other instances, we have a malformed JSON file. Throw an error.
+        std::string msg = "Invalid character '" + std::string(1, c) +
+                          "' at offset " + std::to_string(m_offset);
+        throw std::runtime_error(msg);
+    }
+
+    // Parser
+    void Parser::next()
+    {
+        m_current = m_lexer.next();
+        JSON_STAT(m_stats->tokens++)
+    }
+
+    void Parser::expectEnd()
+    {
+        if (m_current.type != EValueType::End)
+        {
+            throw std::runtime_error("Unexpected '" + std::string(m_lexer.value(m_current)) + "' at offset " +
+                                     std::to_string(m_current.offset));
+        }
+    }
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+    JsonObject Parser::parseValue()
+    {
+        JSON_STAT(m_stats->nodes++)
+
+        // NullType
+        switch (m_current.type)
+        {
+        case (EValueType::End):
+        {
+            throw std::runtime_error("Unexpected end of input");
+        }
+
+        case (EValueType::Null):
+        {
+            next(); // Go to next token
+            return {};
+        }
+
+            // Booleans
+        case (EValueType::Bool):
+        {
+            std::string_view value = m_lexer.value(m_current);
+            next(); // Go to next token
+            return (value == "true" ? JsonObject(true) : JsonObject(false));
+        }
+
+            // Numbers
+        case (EValueType::Number):
+        {
+            JsonObject value = parseNumber(m_lexer.value(m_current));
+            next(); // Go to next token
+            return value;
+        }
+
+            // Strings
+        case (EValueType::String):
+        {
+            // Escaped strings are decoded, so they can't borrow from the source
+            std::string_view raw = m_lexer.value(m_current);
+            std::string_view string = unescapeString(raw, m_scratch);
+            JsonObject value = m_borrow && string.data() == raw.data() ? JsonObject::makeStringView(string)
+                                                                       : JsonObject::makeString(string, m_arena);
+            next(); // Go to next token
+            return value;
+        }
+
+            // Arrays
+        case (EValueType::LBrace):
+        {
+            // Lazy parses leave nested containers until they are accessed
+            if (m_lazy && !m_expand)
+            {
+                return skipLazy(Array);
+            }
+            m_expand = false;
+            JSON_STAT(m_stats->maxDepth = std::max(m_stats->maxDepth, ++m_depth))
+            next(); // Skip start brace
+            size_t base = m_stack.size();
+            if (m_current.type != EValueType::RBrace)
+            {
+                while (true)
+                {
+                    // Recursively parse value onto the scratch stack
+                    m_stack.push_back(parseValue());
+
+                    // Elements are separated by exactly one comma
+                    if (m_current.type == EValueType::RBrace)
+                    {
+                        break;
+                    }
+                    if (m_current.type != EValueType::Comma)
+                    {
+                        throw std::runtime_error("Expected ',' or ']' at offset " + std::to_string(m_current.offset));
+                    }
+                    next(); // Move from comma to the next element
+                }
+            }
+            next(); // Skip end brace
+
+            // Move the elements we parsed into an exactly-sized array
+            JsonArray array(m_arena ? m_arena : std::pmr::get_default_resource());
+            array.reserve(m_stack.size() - base);
+            std::move(m_stack.begin() + static_cast<std::ptrdiff_t>(base), m_stack.end(), std::back_inserter(array));
+            m_stack.resize(base);
+            JSON_STAT(m_depth--)
+            return JsonObject::makeArray(std::move(array), m_arena);
+        }
+
+            // Dictionaries
+        case (EValueType::LBracket):
+        {
+            // Lazy parses leave nested containers until they are accessed
+            if (m_lazy && !m_expand)
+            {
+                return skipLazy(Dictionary);
+            }
+            m_expand = false;
+            JSON_STAT(m_stats->maxDepth = std::max(m_stats->maxDepth, ++m_depth))
+            next(); // Skip start bracket
+            size_t base = m_stack.size();
+            size_t keyBase = m_keys.size();
+
+            if (m_current.type != EValueType::RBracket)
+            {
+                while (true)
+                {
+                    // Parse key
+                    if (m_current.type != EValueType::String)
+                    {
+                        throw std::runtime_error("Expected string key");
+                    }
+                    std::string_view key = storeKey(m_lexer.value(m_current));
+                    next(); // Move from key to expected colon
+
+                    // Parse value
+                    if (m_current.type != EValueType::Colon)
+                    {
+                        throw std::runtime_error("Expected colon");
+                    }
+                    next(); // Move from colon to expected value
+
+                    // Recursively parse value onto the scratch stack
+                    m_keys.push_back(key);
+                    m_stack.push_back(parseValue());
+
+                    // Entries are separated by exactly one comma
+                    if (m_current.type == EValueType::RBracket)
+                    {
+                        break;
+                    }
+                    if (m_current.type != EValueType::Comma)
+                    {
+                        throw std::runtime_error("Expected ',' or '}' at offset " + std::to_string(m_current.offset));
+                    }
+                    next(); // Move from comma to the next key
+                }
+            }
+
+            next(); // Skip end bracket
+
+            // Move the entries we parsed into an exactly-sized dictionary
+            JsonDict dict(m_arena ? m_arena : std::pmr::get_default_resource());
+            dict.reserve(m_stack.size() - base);
+            for (size_t i = 0; i < m_stack.size() - base; i++)
+            {
+                std::string_view key = m_keys[keyBase + i];
+                if (m_arena != nullptr)
+                {
+                    // Long keys were interned, and live as long as the arena
+                    dict.insert_or_assign(JsonKey::borrow(key), std::move(m_stack[base + i]));
+                }
+                else
+                {
+                    dict.insert_or_assign(key, std::move(m_stack[base + i]));
+                }
+            }
+            m_stack.resize(base);
+            m_keys.resize(keyBase);
+            JSON_STAT(m_depth--)
+            return JsonObject::makeDict(std::move(dict), m_arena);
+        }
+
+        default:
+        {
+            throw std::runtime_error("Unexpected '" + std::string(m_lexer.value(m_current)) + "' at offset " +
+                                     std::to_string(m_current.offset));
+        }
+        }
+    }
+
+#pragma clang diagnostic pop
+
+    Parser::Parser() : m_lexer(std::string_view())
+    {
+    }
+
+    Parser::Parser(Lexer* lexer, std::pmr::memory_resource* arena) : m_lexer(*lexer), m_arena(arena)
+    {
+        next(); // Pull the first token
+        m_json = parseValue();
+    }
+
+    JsonObject& Parser::parse(std::string_view string, std::pmr::memory_resource* arena, bool borrow)
+    {
+        reset();
+        m_lexer = Lexer(string);
+        m_arena = arena;
+        m_borrow = borrow;
+        m_lazy = false;
+        next(); // Pull the first token
+        m_json = parseValue();
+        expectEnd();
+        return m_json;
+    }
+
+    JsonObject& Parser::parseLazy(std::string_view string, std::pmr::memory_resource* arena, bool borrow)
+    {
+        if (arena == nullptr)
+        {
+            throw std::runtime_error("Lazy parsing requires an arena");
+        }
+        reset();
+        m_lexer = Lexer(string);
+        m_arena = arena;
+        m_borrow = borrow;
+        m_lazy = true;
+        m_expand = false;
+        next(); // Pull the first token
+        m_json = parseValue();
+        expectEnd();
+        return m_json;
+    }
+
+    JsonObject Parser::expand(const LazyNode& node)
+    {
+        // Start over at the node's opening bracket, in the same source
+        m_stack.clear();
+        m_keys.clear();
+        m_lexer = Lexer(m_lexer.source(), node.offset);
+        m_expand = true;
+        next(); // Pull the opening bracket
+        return parseValue();
+    }
+
+    std::string_view Parser::storeKey(std::string_view text)
+    {
+        std::string_view key = unescapeString(text, m_scratch);
+        bool escaped = key.data() != text.data();
+        if (m_arena != nullptr && key.size() > JsonKey::SMALL_KEY_SIZE)
+        {
+            // Short keys are stored inline, so only long keys are interned.
+            // Decoded keys must be copied out of the scratch buffer.
+            return m_keyTable.intern(key, m_arena, m_borrow && !escaped);
+        }
+        if (!escaped)
+        {
+            return key;
+        }
+        std::pmr::memory_resource* resource = m_arena != nullptr ? m_arena : &m_decodedKeys;
+        auto* copy = static_cast<char*>(resource->allocate(std::max<size_t>(key.size(), 1), 1));
+        std::memcpy(copy, key.data(), key.size());
+        return {copy, key.size()};
+    }
+
+    JsonObject Parser::skipLazy(EValueType type)
+    {
+        void* memory = m_arena->allocate(sizeof(LazyNode), alignof(LazyNode));
+        auto* node = new (memory) LazyNode{this, m_current.offset, JsonObject()};
+        m_lexer.skipContainer(m_current);
+        next(); // Move past the closing bracket
+        return JsonObject::makeLazy(type, node);
+    }
+
+    void Parser::reset()
+    {
+        m_json = JsonObject();
+        m_stack.clear();
+        m_keys.clear();
+        m_keyTable.clear();
+        m_decodedKeys.release();
+        m_lexer = Lexer(std::string_view());
+        m_arena = nullptr;
+        m_borrow = false;
+#if JSON_ENABLE_STATS == true
+        m_depth = 0;
+#endif
+    }
+
+    JsonObject& Parser::get()
+    {
+        return m_json;
+    }
+
+    void Parser::setStats([[maybe_unused]] ParseStats* stats)
+    {
+#if JSON_ENABLE_STATS == true
+        m_stats = stats;
+        m_depth = 0;
+#endif
+    }
+
+    // Parallel parsing
+    /// <summary>
+    /// How a document is split for a parallel parse. Large arrays and
+    /// dictionaries become Containers, whose elements are either runs of
+    /// consecutive small elements, each parsed by one task, or large
+    /// Containers in turn.
+    /// </summary>
+    struct ParallelPlan {
+        struct Run {
+            size_t offset = 0; // Of the first element (or key)
+            size_t count = 0;
+            bool dict = false;
+            std::pmr::memory_resource* arena = nullptr;
+            std::vector<JsonObject> values;
+            std::vector<std::string_view> keys;
+        };
+
+        struct Segment {
+            size_t run = std::string_view::npos;       // A run, or
+            size_t container = std::string_view::npos; // a large container
+            std::string_view key;                      // and its key, in a dictionary
+        };
+
+        struct Container {
+            bool dict = false;
+            size_t size = 0;
+            std::vector<Segment> segments;
+            JsonObject value;
+        };
+
+        std::string_view source;
+        size_t chunkSize = 0;
+        std::vector<Run> runs;
+        std::vector<Container> containers;
+
+        size_t split(size_t open);
+    };
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+    /// <summary>
+    /// Returns the offset of the first character at or after `offset` which is
+    /// not whitespace.
+    /// </summary>
+    static size_t skipSpace(std::string_view string, size_t offset)
+    {
+        while (offset < string.size() && IS_WHITESPACE(string[offset]))
+        {
+            offset++;
+        }
+        return offset;
+    }
+
+    /// <summary>
+    /// Adds the container opened at `open` to the plan, finding the extent of
+    /// its runs and large containers from the lexer's block masks without
+    /// tokenizing the elements.
+    /// </summary>
+    /// <returns>The offset just past the container.</returns>
+    size_t ParallelPlan::split(size_t open)
+    {
+        size_t index = containers.size();
+        bool dict = source[open] == '{';
+        EValueType close = dict ? EValueType::RBracket : EValueType::RBrace;
+        containers.emplace_back().dict = dict;
+
+        Lexer lexer(source, open + 1);
+        size_t begin = skipSpace(source, open + 1);
+        if (begin < source.size() && source[begin] == (dict ? '}' : ']'))
+        {
+            return begin + 1;
+        }
+        while (true)
+        {
+            // Elements join a run until it reaches the chunk size
+            ElementScan scan = lexer.scanElements(begin, begin + chunkSize, chunkSize, dict);
+            if (scan.count > 0)
+            {
+                Run& run = runs.emplace_back();
+                run.offset = begin;
+                run.count = scan.count;
+                run.dict = dict;
+                containers[index].segments.emplace_back().run = runs.size() - 1;
+                containers[index].size += scan.count;
+            }
+            if (scan.closed)
+            {
+                return lexer.offset();
+            }
+            if (scan.container == std::string_view::npos)
+            {
+                begin = skipSpace(source, lexer.offset());
+                continue;
+            }
+
+            // Large containers are split in turn. Only the tokens of their
+            // element before the bracket are lexed, to find a dictionary's key.
+            Lexer element(source, scan.element);
+            Token token = element.next();
+            std::string_view key;
+            if (dict)
+            {
+                if (token.type != EValueType::String)
+                {
+                    throw std::runtime_error("Expected string key");
+                }
+                key = element.value(token);
+                if (element.next().type != EValueType::Colon)
+                {
+                    throw std::runtime_error("Expected colon");
+                }
+                token = element.next();
+            }
+            if (token.offset != scan.container)
+            {
+                throw std::runtime_error("Unexpected '" + std::string(element.value(token)) + "' at offset " +
+                                         std::to_string(token.offset));
+            }
+            Segment& segment = containers[index].segments.emplace_back();
+            segment.container = containers.size();
+            segment.key = key;
+            containers[index].size++;
+            split(scan.container);
+
+            token = lexer.next();
+            if (token.type == close)
+            {
+                return lexer.offset();
+            }
+            if (token.type != EValueType::Comma)
+            {
+                throw std::runtime_error(std::string(dict ? "Expected ',' or '}'" : "Expected ',' or ']'") +
+                                         " at offset " + std::to_string(token.offset));
+            }
+            begin = skipSpace(source, lexer.offset());
+        }
+    }
+
+#pragma clang diagnostic pop
+
+    void Parser::parseRun(std::string_view string, size_t offset, size_t count, bool dict,
+                          std::pmr::memory_resource* arena, bool borrow, std::vector<JsonObject>& values,
+                          std::vector<std::string_view>& keys)
+    {
+        reset();
+        m_lexer = Lexer(string, offset);
+        m_arena = arena;
+        m_borrow = borrow;
+        m_lazy = false;
+        next(); // Pull the first token
+
+        // Runs start at an element, and end at a comma or the container's end
+        EValueType close = dict ? EValueType::RBracket : EValueType::RBrace;
+        const char* expected = dict ? "Expected ',' or '}'" : "Expected ',' or ']'";
+        values.reserve(count);
+        keys.reserve(dict ? count : 0);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i > 0)
+            {
+                if (m_current.type != EValueType::Comma)
+                {
+                    throw std::runtime_error(std::string(expected) + " at offset " + std::to_string(m_current.offset));
+                }
+                next();
+            }
+
+            if (dict)
+            {
+                if (m_current.type != EValueType::String)
+                {
+                    throw std::runtime_error("Expected string key");
+                }
+                keys.push_back(storeKey(m_lexer.value(m_current)));
+                next(); // Move from key to expected colon
+                if (m_current.type != EValueType::Colon)
+                {
+                    throw std::runtime_error("Expected colon");
+                }
+                next(); // Move from colon to expected value
+            }
+            values.push_back(parseValue());
+        }
+        if (m_current.type != EValueType::Comma && m_current.type != close)
+        {
+            throw std::runtime_error(std::string(expected) + " at offset " + std::to_string(m_current.offset));
+        }
+    }
+
+    JsonObject& Parser::parseParallel(std::string_view string, std::pmr::memory_resource* arena, bool borrow,
+                                      ThreadPool& pool,
+                                      std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>>& arenas)
+    {
+        // Aim for several runs per thread, so that stealing can balance them
+        ParallelPlan plan;
+        plan.source = string;
+        plan.chunkSize = std::clamp<size_t>(string.size() / (pool.size() * 16), PARALLEL_MIN_CHUNK, PARALLEL_MAX_CHUNK);
+
+        Lexer lexer(string);
+        Token root = lexer.next();
+        if (string.size() < plan.chunkSize * 2 ||
+            (root.type != EValueType::LBrace && root.type != EValueType::LBracket))
+        {
+            return parse(string, arena, borrow);
+        }
+        size_t end = plan.split(root.offset);
+
+        // Nothing but whitespace may follow the root. Invalid characters fail
+        // in the lexer with the same error as in an eager parse.
+        Lexer tail(string, end);
+        Token token = tail.next();
+        if (token.type != EValueType::End)
+        {
+            throw std::runtime_error("Unexpected '" + std::string(tail.value(token)) + "' at offset " +
+                                     std::to_string(token.offset));
+        }
+
+        // Parse the runs, each into its own arena, with one Parser per thread
+        for (ParallelPlan::Run& run : plan.runs)
+        {
+            arenas.push_back(std::make_unique<std::pmr::monotonic_buffer_resource>(plan.chunkSize));
+            run.arena = arenas.back().get();
+        }
+        pool.parallelFor(plan.runs.size(), [&](size_t i) {
+            static thread_local Parser parser;
+            ParallelPlan::Run& run = plan.runs[i];
+            parser.parseRun(string, run.offset, run.count, run.dict, run.arena, borrow, run.values, run.keys);
+            parser.reset();
+        });
+
+        // Assemble the containers in reverse, so that each one's large
+        // containers are complete before it
+        reset();
+        m_arena = arena;
+        m_borrow = borrow;
+        for (size_t i = plan.containers.size(); i-- > 0;)
+        {
+            ParallelPlan::Container& container = plan.containers[i];
+            if (container.dict)
+            {
+                JsonDict dict(arena);
+                dict.reserve(container.size);
+                for (const ParallelPlan::Segment& segment : container.segments)
+                {
+                    if (segment.run != std::string_view::npos)
+                    {
+                        ParallelPlan::Run& run = plan.runs[segment.run];
+                        for (size_t j = 0; j < run.values.size(); j++)
+                        {
+                            dict.insert_or_assign(JsonKey::borrow(run.keys[j]), std::move(run.values[j]));
+                        }
+                        continue;
+                    }
+                    std::string_view key = storeKey(segment.key);
+                    dict.insert_or_assign(JsonKey::borrow(key), std::move(plan.containers[segment.container].value));
+                }
+                container.value = JsonObject::makeDict(std::move(dict), arena);
+            }
+            else
+            {
+                JsonArray array(arena);
+                array.reserve(container.size);
+                for (const ParallelPlan::Segment& segment : container.segments)
+                {
+                    if (segment.run != std::string_view::npos)
+                    {
+                        ParallelPlan::Run& run = plan.runs[segment.run];
+                        std::move(run.values.begin(), run.values.end(), std::back_inserter(array));
+                        continue;
+                    }
+                    array.push_back(std::move(plan.containers[segment.container].value));
+                }
+                container.value = JsonObject::makeArray(std::move(array), arena);
+            }
+        }
+        m_json = std::move(plan.containers.front().value);
+        return m_json;
+    }
+
+    // Paths
+    Path::Path(std::string_view path)
+    {
+        if (path.empty() || path.front() == '/')
+        {
+            compilePointer(path);
+        }
+        else
+        {
+            compilePath(path);
+        }
+    }
+
+    /// <summary>
+    /// Returns the array index `text` names, or npos if it is not a canonical
+    /// non-negative integer.
+    /// </summary>
+    static size_t parseIndex(std::string_view text)
+    {
+        if (text.empty() || (text.size() > 1 && text.front() == '0'))
+        {
+            return std::string_view::npos;
+        }
+        size_t index = 0;
+        auto result = std::from_chars(text.data(), text.data() + text.size(), index);
+        if (result.ec != std::errc() || result.ptr != text.data() + text.size())
         {
-            m_offset += 4;
-            token.type = EValueType::Null;
-            return token;
+            return std::string_view::npos;
+        }
+        return index;
+    }
+
+    void Path::compilePointer(std::string_view pointer)
+    {
+        // Each reference token follows a '/'
+        size_t offset = 0;
+        while (offset < pointer.size())
+        {
+            size_t end = std::min(pointer.find('/', offset + 1), pointer.size());
+            std::string_view token = pointer.substr(offset + 1, end - offset - 1);
+
+            Step step;
+            for (size_t i = 0; i < token.size(); i++)
+            {
+                if (token[i] != '~')
+                {
+                    step.key.push_back(token[i]);
+                    continue;
+                }
+                if (i + 1 == token.size() || (token[i + 1] != '0' && token[i + 1] != '1'))
+                {
+                    throw std::runtime_error("Invalid escape in JSON Pointer: " + std::string(pointer));
+                }
+                step.key.push_back(token[++i] == '0' ? '~' : '/');
+            }
+            step.index = parseIndex(step.key);
+            m_steps.push_back(std::move(step));
+            offset = end;
+        }
+    }
+
+    void Path::compilePath(std::string_view path)
+    {
+        if (path.empty() || path.front() != '$')
+        {
+            throw std::runtime_error("Path must start with '$': " + std::string(path));
+        }
+
+        size_t offset = 1;
+        while (offset < path.size())
+        {
+            Step step;
+            if (path[offset] == '.')
+            {
+                // .name or .*
+                size_t end = std::min(path.find_first_of(".[", offset + 1), path.size());
+                std::string_view name = path.substr(offset + 1, end - offset - 1);
+                if (name.empty())
+                {
+                    throw std::runtime_error("Empty name in path: " + std::string(path));
+                }
+                if (name == "*")
+                {
+                    step.kind = Step::Any;
+                }
+                else
+                {
+                    step.key = name;
+                }
+                offset = end;
+            }
+            else if (path[offset] == '[')
+            {
+                size_t end = path.find(']', offset);
+                if (end == std::string_view::npos)
+                {
+                    throw std::runtime_error("Unterminated '[' in path: " + std::string(path));
+                }
+                std::string_view inner = path.substr(offset + 1, end - offset - 1);
+                if (inner == "*")
+                {
+                    step.kind = Step::Any;
+                }
+                else if (inner.size() >= 2 && (inner.front() == '\'' || inner.front() == '"') &&
+                         inner.back() == inner.front())
+                {
+                    // ['name'] or ["name"], which may contain '.' and '['
+                    step.key = inner.substr(1, inner.size() - 2);
+                }
+                else
+                {
+                    step.kind = Step::Index;
+                    step.index = parseIndex(inner);
+                    if (step.index == std::string_view::npos)
+                    {
+                        throw std::runtime_error("Invalid index in path: " + std::string(path));
+                    }
+                }
+                offset = end + 1;
+            }
+            else
+            {
+                throw std::runtime_error("Unexpected character '" + std::string(1, path[offset]) +
+                                         "' in path: " + std::string(path));
+            }
+            m_wildcard |= step.kind == Step::Any;
+            m_steps.push_back(std::move(step));
+        }
+    }
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+    bool Path::evaluate(const JsonObject& value, size_t step, std::vector<const JsonObject*>& matches,
+                        bool all) const
+    {
+        if (step == m_steps.size())
+        {
+            matches.push_back(&value);
+            return !all;
+        }
+
+        const Step& current = m_steps[step];
+        if (value.type() == Dictionary)
+        {
+            if (current.kind == Step::Any)
+            {
+                for (const auto& [k, v] : value.getDictRef())
+                {
+                    if (evaluate(v, step + 1, matches, all))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            const JsonObject* child = current.kind == Step::Key ? value.find(current.key) : nullptr;
+            return child != nullptr && evaluate(*child, step + 1, matches, all);
+        }
+        if (value.type() == Array)
+        {
+            std::span<const JsonObject> array = value.getArraySpan();
+            if (current.kind == Step::Any)
+            {
+                for (const JsonObject& v : array)
+                {
+                    if (evaluate(v, step + 1, matches, all))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            return current.index < array.size() && evaluate(array[current.index], step + 1, matches, all);
+        }
+        return false;
+    }
+
+    bool Path::evaluate(Lexer& lexer, const Token& token, size_t step, Parser& parser,
+                        std::vector<JsonObject>& matches) const
+    {
+        bool container = token.type == EValueType::LBrace || token.type == EValueType::LBracket;
+        if (step == m_steps.size())
+        {
+            // Parse just this value, from its text
+            size_t begin = token.offset;
+            size_t end = token.offset + token.length;
+            if (token.type == EValueType::String)
+            {
+                // Include the quotes
+                begin--;
+                end++;
+            }
+            else if (container)
+            {
+                lexer.skipContainer(token);
+                end = lexer.offset();
+            }
+            matches.push_back(std::move(parser.parse(lexer.source().substr(begin, end - begin))));
+            return !m_wildcard;
+        }
+
+        const Step& current = m_steps[step];
+
+        // Dictionaries
+        if (token.type == EValueType::LBracket)
+        {
+            if (current.kind == Step::Index)
+            {
+                lexer.skipContainer(token);
+                return false;
+            }
+            std::string scratch; // Escaped keys are decoded to compare them
+            for (Token key = lexer.next(); key.type != EValueType::RBracket; key = lexer.next())
+            {
+                if (key.type == EValueType::Comma)
+                {
+                    continue;
+                }
+                if (key.type != EValueType::String)
+                {
+                    throw std::runtime_error("Expected string key");
+                }
+                if (lexer.next().type != EValueType::Colon)
+                {
+                    throw std::runtime_error("Expected colon");
+                }
+                Token value = lexer.next();
+                if (current.kind == Step::Any || unescapeString(lexer.value(key), scratch) == current.key)
+                {
+                    if (evaluate(lexer, value, step + 1, parser, matches))
+                    {
+                        return true;
+                    }
+                }
+                else if (value.type == EValueType::LBrace || value.type == EValueType::LBracket)
+                {
+                    lexer.skipContainer(value);
+                }
+            }
+            return false;
+        }
+
+        // Arrays
+        if (token.type == EValueType::LBrace)
+        {
+            if (current.kind == Step::Key && current.index == std::string_view::npos)
+            {
+                lexer.skipContainer(token);
+                return false;
+            }
+            size_t index = 0;
+            for (Token value = lexer.next(); value.type != EValueType::RBrace; value = lexer.next())
+            {
+                if (value.type == EValueType::Comma)
+                {
+                    continue;
+                }
+                if (value.type == EValueType::End)
+                {
+                    throw std::runtime_error("Unterminated array");
+                }
+                if (current.kind == Step::Any || index == current.index)
+                {
+                    if (evaluate(lexer, value, step + 1, parser, matches))
+                    {
+                        return true;
+                    }
+                }
+                else if (value.type == EValueType::LBrace || value.type == EValueType::LBracket)
+                {
+                    lexer.skipContainer(value);
+                }
+                index++;
+            }
+        }
+        return false;
+    }
+
+#pragma clang diagnostic pop
+
+    const JsonObject* Path::find(const JsonObject& root) const
+    {
+        std::vector<const JsonObject*> matches;
+        evaluate(root, 0, matches, false);
+        return matches.empty() ? nullptr : matches.front();
+    }
+
+    std::vector<const JsonObject*> Path::findAll(const JsonObject& root) const
+    {
+        std::vector<const JsonObject*> matches;
+        evaluate(root, 0, matches, true);
+        return matches;
+    }
+
+    std::vector<JsonObject> Path::extract(std::string_view json) const
+    {
+        Lexer lexer(json);
+        Parser parser;
+        std::vector<JsonObject> matches;
+        evaluate(lexer, lexer.next(), 0, parser, matches);
+        return matches;
+    }
+
+    size_t Path::size() const
+    {
+        return m_steps.size();
+    }
+
+    // Events
+    /// <summary>
+    /// Passes the value at `token` to `handler`, if it is not a container.
+    /// Escaped strings are decoded into `scratch`.
+    /// </summary>
+    static bool readScalar(const Lexer& lexer, const Token& token, Handler& handler, std::string& scratch)
+    {
+        switch (token.type)
+        {
+        case (EValueType::String):
+        {
+            return handler.onString(unescapeString(lexer.value(token), scratch));
+        }
+        case (EValueType::Number):
+        {
+            JsonObject number = parseNumber(lexer.value(token));
+            if (number.type() == Int)
+            {
+                return handler.onInt64(number.getInt64());
+            }
+            if (number.type() == UInt)
+            {
+                return handler.onUInt64(number.getUInt64());
+            }
+            return handler.onDouble(number.getDouble());
+        }
+        case (EValueType::Bool):
+        {
+            return handler.onBool(lexer.value(token) == "true");
+        }
+        case (EValueType::Null):
+        {
+            return handler.onNull();
+        }
+        case (EValueType::End):
+        {
+            throw std::runtime_error("Unexpected end of input");
+        }
+        default:
+        {
+            throw std::runtime_error("Unexpected '" + std::string(lexer.value(token)) + "' at offset " +
+                                     std::to_string(token.offset));
+        }
+        }
+    }
+
+    /// <summary>
+    /// Reads one value from `lexer` into `handler`, which must be the whole of
+    /// the remaining input. Containers are tracked on an explicit stack rather
+    /// than by recursion.
+    /// </summary>
+    static bool readValue(Lexer& lexer, Handler& handler)
+    {
+        struct Frame {
+            bool dict;
+            size_t size;
+        };
+        std::vector<Frame> stack;
+
+        // Escaped strings and keys are decoded into this; the rest are views
+        // into the source
+        std::string scratch;
+
+        Token token = lexer.next();
+        while (true)
+        {
+            // Dictionary entries start with a key
+            if (!stack.empty() && stack.back().dict)
+            {
+                if (token.type != EValueType::String)
+                {
+                    throw std::runtime_error("Expected string key");
+                }
+                if (!handler.onKey(unescapeString(lexer.value(token), scratch)))
+                {
+                    return false;
+                }
+                if (lexer.next().type != EValueType::Colon)
+                {
+                    throw std::runtime_error("Expected colon");
+                }
+                token = lexer.next();
+            }
+
+            // The value
+            if (!stack.empty())
+            {
+                stack.back().size++;
+            }
+            if (token.type == EValueType::LBrace || token.type == EValueType::LBracket)
+            {
+                bool dict = token.type == EValueType::LBracket;
+                if (!(dict ? handler.onStartObject() : handler.onStartArray()))
+                {
+                    return false;
+                }
+                stack.push_back({dict, 0});
+                token = lexer.next();
+
+                // Anything but an immediate close starts the first entry
+                if (token.type != (dict ? EValueType::RBracket : EValueType::RBrace))
+                {
+                    continue;
+                }
+            }
+            else
+            {
+                if (!readScalar(lexer, token, handler, scratch))
+                {
+                    return false;
+                }
+                token = lexer.next();
+            }
+
+            // Close any containers which end here, then move to the next entry
+            while (!stack.empty())
+            {
+                Frame& frame = stack.back();
+                if (token.type == EValueType::Comma)
+                {
+                    token = lexer.next();
+                    break;
+                }
+                if (token.type != (frame.dict ? EValueType::RBracket : EValueType::RBrace))
+                {
+                    throw std::runtime_error(std::string(frame.dict ? "Expected ',' or '}'" : "Expected ',' or ']'") +
+                                             " at offset " + std::to_string(token.offset));
+                }
+                Frame closed = frame;
+                stack.pop_back();
+                if (!(closed.dict ? handler.onEndObject(closed.size) : handler.onEndArray(closed.size)))
+                {
+                    return false;
+                }
+                token = lexer.next();
+            }
+            if (stack.empty())
+            {
+                // Nothing but whitespace may follow the root value
+                if (token.type != EValueType::End)
+                {
+                    throw std::runtime_error("Unexpected '" + std::string(lexer.value(token)) + "' at offset " +
+                                             std::to_string(token.offset));
+                }
+                return true;
+            }
+        }
+    }
+
+    bool readString(std::string_view string, Handler& handler)
+    {
+        Lexer lexer(string);
+        return readValue(lexer, handler);
+    }
+
+    bool readFile(const std::string& filename, Handler& handler)
+    {
+        MappedFile file(filename);
+        Lexer lexer(file.view());
+        return readValue(lexer, handler);
+    }
+
+    // Push parser
+    /// <summary>
+    /// Returns the offset of the quote closing a string in `chunk`, starting
+    /// from `offset`, or npos if the string continues into the next chunk.
+    /// `escape` carries a backslash at the end of one chunk into the next.
+    /// </summary>
+    static size_t findStringEnd(std::string_view chunk, size_t offset, bool& escape)
+    {
+        if (escape)
+        {
+            if (offset >= chunk.size())
+            {
+                return std::string_view::npos;
+            }
+            escape = false;
+            offset++;
+        }
+
+        // Jump between backslashes until the next quote is not escaped, only
+        // searching for a new quote once the last one has been passed
+        size_t quote = 0;
+        bool search = true;
+        while (true)
+        {
+            if (search || quote < offset)
+            {
+                search = false;
+                const void* found = std::memchr(chunk.data() + offset, '"', chunk.size() - offset);
+                quote = found != nullptr ? static_cast<const char*>(found) - chunk.data() : chunk.size();
+            }
+            const void* backslash = std::memchr(chunk.data() + offset, '\\', quote - offset);
+            if (backslash == nullptr)
+            {
+                return quote < chunk.size() ? quote : std::string_view::npos;
+            }
+            offset = static_cast<const char*>(backslash) - chunk.data() + 2;
+            if (offset > chunk.size())
+            {
+                escape = true;
+                return std::string_view::npos;
+            }
+        }
+    }
+
+    void PushParser::feed(std::string_view chunk)
+    {
+        // Finish any token the last chunk split
+        size_t offset = m_partialType != EValueType::End ? scan(chunk, 0) : 0;
+
+        while (offset < chunk.size())
+        {
+            char c = chunk[offset];
+            if (IS_WHITESPACE(c))
+            {
+                offset++;
+                continue;
+            }
+
+            // Separators
+            EValueType type = EValueType::End;
+            if (IS_COMMA(c))
+            {
+                type = EValueType::Comma;
+            }
+            else if (IS_COLON(c))
+            {
+                type = EValueType::Colon;
+            }
+            else if (IS_LBRACE(c))
+            {
+                type = EValueType::LBrace;
+            }
+            else if (IS_RBRACE(c))
+            {
+                type = EValueType::RBrace;
+            }
+            else if (IS_LBRACKET(c))
+            {
+                type = EValueType::LBracket;
+            }
+            else if (IS_RBRACKET(c))
+            {
+                type = EValueType::RBracket;
+            }
+            if (type != EValueType::End)
+            {
+                token(type, chunk.substr(offset, 1), offset);
+                offset++;
+                continue;
+            }
+
+            // Strings, numbers and literals, which may be split between chunks
+            if (IS_QUOTE(c))
+            {
+                m_partialType = EValueType::String;
+                offset++; // Skip entry quote
+            }
+            else if (IS_NUMBER(c))
+            {
+                m_partialType = EValueType::Number;
+            }
+            else if (c == 't' || c == 'f')
+            {
+                m_partialType = EValueType::Bool;
+            }
+            else if (c == 'n')
+            {
+                m_partialType = EValueType::Null;
+            }
+            else
+            {
+                throw std::runtime_error("Invalid character '" + std::string(1, c) + "' at offset " +
+                                         std::to_string(m_consumed + offset));
+            }
+            offset = scan(chunk, offset);
         }
+        m_consumed += chunk.size();
+    }
 
-        // Separators
-        if (IS_COMMA(m_string[m_offset]))
+    /// <summary>
+    /// Continues the split token from `offset` in `chunk`, and returns the offset
+    /// after it, or the end of the chunk if the token continues into the next.
+    /// </summary>
+    size_t PushParser::scan(std::string_view chunk, size_t offset)
+    {
+        size_t end = offset;
+        if (m_partialType == EValueType::String)
         {
-            m_offset++;
-            token.type = EValueType::Comma;
-            return token;
+            end = findStringEnd(chunk, offset, m_escape);
+            end = std::min(end, chunk.size());
         }
-
-        if (IS_LBRACE(m_string[m_offset]))
+        else if (m_partialType == EValueType::Number)
         {
-            m_offset++;
-            token.type = EValueType::LBrace;
-            return token;
+            while (end < chunk.size() && (IS_NUMBER(chunk[end]) || IS_EXPONENT(chunk[end])))
+            {
+                end++;
+            }
         }
-
-        if (IS_RBRACE(m_string[m_offset]))
+        else
         {
-            m_offset++;
-            token.type = EValueType::RBrace;
-            return token;
+            while (end < chunk.size() && chunk[end] >= 'a' && chunk[end] <= 'z')
+            {
+                end++;
+            }
         }
 
-        if (IS_LBRACKET(m_string[m_offset]))
+        // The token continues into the next chunk. A string may end exactly
+        // at the end of this one, but needs its closing quote.
+        if (end == chunk.size())
         {
-            m_offset++;
-            token.type = EValueType::LBracket;
-            return token;
+            m_partial.append(chunk.substr(offset));
+            return chunk.size();
         }
 
-        if (IS_RBRACKET(m_string[m_offset]))
+        // Only tokens which were split need copying
+        std::string_view text = chunk.substr(offset, end - offset);
+        if (!m_partial.empty())
         {
-            m_offset++;
-            token.type = EValueType::RBracket;
-            return token;
+            m_partial.append(text);
+            text = m_partial;
         }
+        EValueType type = m_partialType;
+        m_partialType = EValueType::End;
+        token(type, text, offset);
+        m_partial.clear();
+        return type == EValueType::String ? end + 1 : end; // Skip exit quote
+    }
 
-        if (IS_COLON(m_string[m_offset]))
+    void PushParser::token(EValueType type, std::string_view text, size_t offset)
+    {
+        switch (m_state)
         {
-            m_offset++;
-            token.type = EValueType::Colon;
-            return token;
+        case (FirstKey):
+        {
+            if (type == EValueType::RBracket)
+            {
+                close(type, offset);
+                return;
+            }
+            [[fallthrough]];
+        }
+        case (Key):
+        {
+            if (type != EValueType::String)
+            {
+                throw std::runtime_error("Expected string key at offset " + std::to_string(m_consumed + offset));
+            }
+            m_keys.emplace_back(unescapeString(text, m_scratch));
+            m_state = Colon;
+            return;
+        }
+        case (Colon):
+        {
+            if (type != EValueType::Colon)
+            {
+                throw std::runtime_error("Expected colon at offset " + std::to_string(m_consumed + offset));
+            }
+            m_state = Value;
+            return;
+        }
+        case (Separator):
+        {
+            if (type == EValueType::Comma)
+            {
+                m_state = m_frames.back().dict ? Key : Value;
+                return;
+            }
+            close(type, offset);
+            return;
+        }
+        case (FirstValue):
+        {
+            if (type == EValueType::RBrace)
+            {
+                close(type, offset);
+                return;
+            }
+            [[fallthrough]];
+        }
+        case (Value):
+        {
+            break;
+        }
         }
 
-        // In all other instances, we have a malformed JSON file. Throw an error.
-        std::string msg(&"Invalid character "[m_string[m_offset]]);
-        throw std::runtime_error(msg);
+        switch (type)
+        {
+        case (EValueType::LBrace):
+        {
+            m_frames.push_back({false, m_stack.size()});
+            m_state = FirstValue;
+            return;
+        }
+        case (EValueType::LBracket):
+        {
+            m_frames.push_back({true, m_stack.size()});
+            m_state = FirstKey;
+            return;
+        }
+        case (EValueType::String):
+        {
+            value(JsonObject::makeString(unescapeString(text, m_scratch), nullptr));
+            return;
+        }
+        case (EValueType::Number):
+        {
+            value(parseNumber(text));
+            return;
+        }
+        case (EValueType::Bool):
+        {
+            if (text != "true" && text != "false")
+            {
+                break;
+            }
+            value(JsonObject(text == "true"));
+            return;
+        }
+        case (EValueType::Null):
+        {
+            if (text != "null")
+            {
+                break;
+            }
+            value({});
+            return;
+        }
+        default:
+        {
+            break;
+        }
+        }
+        throw std::runtime_error("Unexpected '" + std::string(text) + "' at offset " +
+                                 std::to_string(m_consumed + offset));
     }
 
-    // Parser
-    void Parser::next()
+    /// <summary>
+    /// Adds a completed value to the open container, or to the completed top
+    /// level values if there is none.
+    /// </summary>
+    void PushParser::value(JsonObject value)
     {
-        current++;
-        pos++;
+        if (m_frames.empty())
+        {
+            m_values.push_back(std::move(value));
+            m_state = Value;
+            return;
+        }
+        m_stack.push_back(std::move(value));
+        m_state = Separator;
     }
 
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "misc-no-recursion"
-
-    JsonObject Parser::parse()
+    /// <summary>
+    /// Closes the innermost container at `type`, which must match it.
+    /// </summary>
+    void PushParser::close(EValueType type, size_t offset)
     {
-        // NullType
-        switch (current->type)
+        Frame frame = m_frames.back();
+        if (type != (frame.dict ? EValueType::RBracket : EValueType::RBrace))
         {
-        case (EValueType::Null):
+            throw std::runtime_error(std::string(frame.dict ? "Expected ',' or '}'" : "Expected ',' or ']'") +
+                                     " at offset " + std::to_string(m_consumed + offset));
+        }
+        m_frames.pop_back();
+
+        // Move the values we parsed into an exactly-sized container, as the
+        // Parser does. Every value in a dictionary has a key, and the keys of
+        // nested dictionaries have already been taken.
+        size_t size = m_stack.size() - frame.base;
+        auto first = m_stack.begin() + static_cast<std::ptrdiff_t>(frame.base);
+        if (frame.dict)
         {
-            next(); // Go to next token
-            return {};
+            size_t keyBase = m_keys.size() - size;
+            JsonDict dict;
+            dict.reserve(size);
+            for (size_t i = 0; i < size; i++)
+            {
+                dict.insert_or_assign(std::move(m_keys[keyBase + i]), std::move(first[static_cast<std::ptrdiff_t>(i)]));
+            }
+            m_keys.resize(keyBase);
+            m_stack.resize(frame.base);
+            value(JsonObject::makeDict(std::move(dict), nullptr));
+        }
+        else
+        {
+            JsonArray array(std::pmr::get_default_resource());
+            array.reserve(size);
+            std::move(first, m_stack.end(), std::back_inserter(array));
+            m_stack.resize(frame.base);
+            value(JsonObject::makeArray(std::move(array), nullptr));
         }
+    }
 
-            // Booleans
-        case (EValueType::Bool):
+    void PushParser::finish()
+    {
+        // A number or literal at the end of input has nothing after it to end it
+        if (m_partialType == EValueType::Number || m_partialType == EValueType::Bool ||
+            m_partialType == EValueType::Null)
         {
-            std::string value = current->value;
-            next(); // Go to next token
-            return (value == "true" ? JsonObject(true) : JsonObject(false));
+            EValueType type = m_partialType;
+            m_partialType = EValueType::End;
+            token(type, m_partial, 0);
+            m_partial.clear();
+        }
+        if (m_partialType == EValueType::String)
+        {
+            throw std::runtime_error("Unterminated string at end of input");
         }
+        if (!m_frames.empty() || m_state != Value)
+        {
+            throw std::runtime_error("Unexpected end of input");
+        }
+    }
 
-            // Numbers
-        case (EValueType::Number):
+    std::optional<JsonObject> PushParser::next()
+    {
+        if (m_values.empty())
         {
-            std::string value = current->value;
-            next(); // Go to next token
-            // Decimal values
-            if (value.find('.') != std::string::npos)
-            {
-                return JsonObject(std::stod(value));
-            }
-                // Integer values
-            else
-            {
-                return JsonObject(std::stoi(value));
-            }
+            return std::nullopt;
         }
+        JsonObject value = std::move(m_values.front());
+        m_values.pop_front();
+        return value;
+    }
 
-            // Strings
-        case (EValueType::String):
+    size_t PushParser::ready() const
+    {
+        return m_values.size();
+    }
+
+    void PushParser::reset()
+    {
+        m_state = Value;
+        m_partial.clear();
+        m_partialType = EValueType::End;
+        m_escape = false;
+        m_frames.clear();
+        m_stack.clear();
+        m_keys.clear();
+        m_values.clear();
+        m_consumed = 0;
+    }
+
+    // JSON Lines
+    LineReader::LineReader(const std::string& filename)
+        : m_file(filename), m_block(BLOCK_SIZE), m_arena(m_block.data(), m_block.size())
+    {
+        m_input = m_file.view();
+    }
+
+    LineReader::LineReader(std::istream& stream)
+        : m_stream(&stream), m_block(BLOCK_SIZE), m_arena(m_block.data(), m_block.size())
+    {
+    }
+
+    /// <summary>
+    /// Moves the unread input to the front of the buffer and reads another
+    /// block after it.
+    /// </summary>
+    /// <returns>False if there was nothing left to read.</returns>
+    bool LineReader::fill()
+    {
+        if (m_stream == nullptr || !*m_stream)
         {
-            std::string value = current->value;
-            next(); // Go to next token
-            return JsonObject(value);
+            return false;
         }
+        m_buffer.erase(0, m_offset);
+        m_offset = 0;
+
+        size_t size = m_buffer.size();
+        m_buffer.resize(size + BLOCK_SIZE);
+        m_stream->read(m_buffer.data() + size, BLOCK_SIZE);
+        m_buffer.resize(size + static_cast<size_t>(m_stream->gcount()));
+        m_input = m_buffer;
+        return m_buffer.size() > size;
+    }
 
-            // Arrays
-        case (EValueType::LBrace):
+    const JsonObject* LineReader::next()
+    {
+        // The previous value borrowed everything from the arena, so this frees
+        // it and rewinds to the start of the reused block
+        m_arena.release();
+
+        size_t searched = m_offset;
+        while (true)
         {
-            next(); // Skip start brace
-            JsonArray array;
-            while (current->type != EValueType::RBrace)
+            size_t end = m_input.find('\n', searched);
+            if (end == std::string_view::npos)
             {
-                // Skip commas
-                if (current->type == EValueType::Comma)
+                // Only search the newly read input for the end of the line
+                searched = m_input.size() - m_offset;
+                if (fill())
                 {
-                    next(); // Go to next token
                     continue;
                 }
-                JsonObject value = parse(); // Recursively parse value
 
-                // TODO: Figure out why this is needed, otherwise it breaks
-                if (value.type() == EValueType::Null)
+                // The last line need not end in a new line
+                end = m_input.size();
+                if (m_offset >= end)
                 {
-                    break;
+                    return nullptr;
                 }
+            }
 
-                // Add to our array the value we parsed
-                array.push_back(value);
+            std::string_view line = m_input.substr(m_offset, end - m_offset);
+            m_offset = std::min(end + 1, m_input.size());
+            searched = m_offset;
+            m_line++;
+            if (line.find_first_not_of(" \t\r") == std::string_view::npos)
+            {
+                continue;
             }
 
-            next(); // Skip end brace
-            return JsonObject(array);
+            try
+            {
+                return &m_parser.parse(line, &m_arena, true);
+            }
+            catch (const std::exception& e)
+            {
+                // Out of range numbers throw std::out_of_range, which is not a
+                // runtime_error, so every exception is given the line number
+                throw std::runtime_error("Line " + std::to_string(m_line) + ": " + e.what());
+            }
         }
+    }
 
-            // Dictionaries
-        case (EValueType::LBracket):
+    size_t LineReader::line() const
+    {
+        return m_line;
+    }
+
+    LineWriter::LineWriter(std::string& output) : m_writer(output, {.pretty = false})
+    {
+    }
+
+    LineWriter::LineWriter(std::ostream& stream) : m_writer(stream, {.pretty = false})
+    {
+    }
+
+    void LineWriter::write(const JsonObject& value)
+    {
+        m_writer.writeValue(value, 0);
+        m_writer.m_output->push_back('\n');
+        m_writer.checkFlush();
+    }
+
+    void LineWriter::flush()
+    {
+        m_writer.flush();
+    }
+
+    // Thread pool
+    ThreadPool::ThreadPool(size_t threads)
+    {
+        if (threads == 0)
         {
-            next(); // Skip start bracket
-            JsonDict dict;
+            threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        }
+        for (size_t i = 0; i < threads; i++)
+        {
+            m_queues.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 0; i < threads; i++)
+        {
+            m_threads.emplace_back([this, i]() { work(i); });
+        }
+    }
 
-            while (current->type != EValueType::RBracket && current->type > 0)
-            {
-                // Parse key
-                if (current->type != EValueType::String)
-                {
-                    throw std::runtime_error("Expected string key");
-                }
-                std::string key = current->value;
-                next(); // Move from key to expected colon
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
 
-                // Parse value
-                if (current->type != EValueType::Colon)
-                {
-                    throw std::runtime_error("Expected colon");
-                }
-                next(); // Move from colon to expected value
+    // The pool whose worker is running on this thread, if any, and its index
+    static thread_local ThreadPool* t_pool = nullptr;
+    static thread_local size_t t_worker = 0;
+
+    size_t ThreadPool::size() const
+    {
+        return m_threads.size();
+    }
+
+    void ThreadPool::submit(std::function<void()> task)
+    {
+        // Workers queue their own tasks locally; others spread them around
+        size_t index = t_pool == this ? t_worker : m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+        {
+            std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+            m_queues[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queued++;
+        }
+        m_wake.notify_one();
+    }
+
+    bool ThreadPool::runOne(size_t self)
+    {
+        std::function<void()> task;
+        for (size_t i = 0; i < m_queues.size() && !task; i++)
+        {
+            Queue& queue = *m_queues[(self + i) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+            {
+                continue;
+            }
+            if (i == 0)
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+        }
+        if (!task)
+        {
+            return false;
+        }
+        m_queued--;
+        task();
+        return true;
+    }
 
-                // Construct dict obj
-                JsonObject value = parse(); // Recursively parse value
-                dict[key] = value;
+    void ThreadPool::work(size_t index)
+    {
+        t_pool = this;
+        t_worker = index;
+        while (true)
+        {
+            if (runOne(index))
+            {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]() { return m_stop || m_queued > 0; });
+            if (m_stop && m_queued == 0)
+            {
+                return;
+            }
+        }
+    }
 
-                // If there's a comma, skip it
-                if (current->type == EValueType::Comma)
+    void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body)
+    {
+        // Each task claims indices until none are left, which balances uneven
+        // calls without a task per index
+        std::atomic<size_t> next = 0;
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        // The last task to finish wakes the caller once it is waiting on `finished`
+        size_t running = 0;
+        std::mutex runningMutex;
+        std::condition_variable finished;
+        auto task = [&]() {
+            for (size_t i = next++; i < count; i = next++)
+            {
+                try
                 {
-                    next();
-                    continue;
+                    body(i);
                 }
-                // If we're at the end of the dictionary, break the loop
-                if (current->type == EValueType::RBracket)
+                catch (...)
                 {
-                    break;
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error)
+                    {
+                        error = std::current_exception();
+                    }
+                    next = count;
                 }
             }
+            std::lock_guard<std::mutex> lock(runningMutex);
+            if (--running == 0)
+            {
+                finished.notify_one();
+            }
+        };
 
-            next(); // Skip end bracket
-            return JsonObject(dict);
+        size_t tasks = std::min(count, size());
+        running = tasks + 1;
+        for (size_t i = 0; i < tasks; i++)
+        {
+            submit(task);
         }
 
-        default:
+        // Work on this thread too, then help with queued tasks. Once the queues
+        // are empty, the rest are running elsewhere, so wait for them to finish
+        // rather than spin on a core the workers need.
+        task();
+        size_t self = t_pool == this ? t_worker : 0;
+        while (runOne(self))
         {
-            throw std::runtime_error("Unable to parse!");
         }
+        std::unique_lock<std::mutex> lock(runningMutex);
+        finished.wait(lock, [&]() { return running == 0; });
+        if (error)
+        {
+            std::rethrow_exception(error);
         }
     }
 
-#pragma clang diagnostic pop
+    ThreadPool& ThreadPool::shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
 
-    Parser::Parser(Lexer* lexer) : m_lexer(lexer)
+    // Batch loading
+    /// <summary>
+    /// Parses `count` documents on `pool` with `load`, passing each to `done`.
+    /// The first error, prefixed with the `name` of its document, stops the
+    /// batch and is rethrown.
+    /// </summary>
+    static void loadBatch(size_t count, const std::function<void(Document&, Parser&, size_t)>& load,
+                          const std::function<std::string(size_t)>& name,
+                          const std::function<void(size_t, std::unique_ptr<Document>)>& done, ThreadPool* pool)
     {
-        current = &m_lexer->tokens[0];
-        m_json = parse();
+        (pool != nullptr ? *pool : ThreadPool::shared()).parallelFor(count, [&](size_t i) {
+            // Documents are mostly small, so keep the parser's stacks and key
+            // table from one to the next
+            static thread_local Parser parser;
+            auto document = std::make_unique<Document>();
+            try
+            {
+                load(*document, parser, i);
+            }
+            catch (const std::exception& e)
+            {
+                parser.reset();
+                throw std::runtime_error(name(i) + ": " + e.what());
+            }
+            done(i, std::move(document));
+        });
     }
 
-    JsonObject& Parser::get()
+    std::vector<std::unique_ptr<Document>> loadFiles(std::span<const std::string> filenames, ThreadPool* pool)
     {
-        return m_json;
+        std::vector<std::unique_ptr<Document>> documents(filenames.size());
+        loadFiles(filenames, [&](size_t i, std::unique_ptr<Document> document) { documents[i] = std::move(document); },
+                  pool);
+        return documents;
+    }
+
+    void loadFiles(std::span<const std::string> filenames,
+                   const std::function<void(size_t, std::unique_ptr<Document>)>& done, ThreadPool* pool)
+    {
+        loadBatch(filenames.size(),
+                  [&](Document& document, Parser& parser, size_t i) { document.parseFile(filenames[i], parser); },
+                  [&](size_t i) { return filenames[i]; }, done, pool);
+    }
+
+    std::vector<std::unique_ptr<Document>> loadStrings(std::span<const std::string_view> strings, ThreadPool* pool)
+    {
+        std::vector<std::unique_ptr<Document>> documents(strings.size());
+        loadStrings(strings, [&](size_t i, std::unique_ptr<Document> document) { documents[i] = std::move(document); },
+                    pool);
+        return documents;
+    }
+
+    void loadStrings(std::span<const std::string_view> strings,
+                     const std::function<void(size_t, std::unique_ptr<Document>)>& done, ThreadPool* pool)
+    {
+        loadBatch(strings.size(),
+                  [&](Document& document, Parser& parser, size_t i) { document.parse(strings[i], parser); },
+                  [](size_t i) { return "Document " + std::to_string(i); }, done, pool);
     }
 } // namespace JSON
@@ -3,6 +3,12 @@
 
 #define DEBUG_TYPE false
 
+// Whether parsing and formatting collect ParseStats. When false, the
+// instrumentation compiles to nothing.
+#ifndef JSON_ENABLE_STATS
+#define JSON_ENABLE_STATS false
+#endif
+
 #define IS_NUMBER(x) (((x - 48) | (57 - x)) >= 0 || x == 46 || x == 45)
 #define IS_QUOTE(x) x == 34
 #define IS_NOT_QUOTE(x) x != 34
@@ -12,26 +18,53 @@
 #define IS_LBRACKET(x) x == 123
 #define IS_RBRACKET(x) x == 125
 #define IS_COLON(x) x == 58
-
+#define IS_BACKSLASH(x) x == 92
+#define IS_EXPONENT(x) (x == 101 || x == 69 || x == 43)
+#define IS_WHITESPACE(x) (x == 32 || x == 10 || x == 13 || x == 9 || x == 0)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <compare>
+#include <condition_variable>
+#include <cmath>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include <iterator>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <span>
+#include <utility>
 
 namespace JSON {
-    static int CURRENT_INDENT = 0;
-
     // Forward declaration
     class JsonObject;
 
-    typedef std::vector<JsonObject> JsonArray;
-    typedef std::map<std::string, JsonObject> JsonDict;
+    typedef std::pmr::vector<JsonObject> JsonArray;
+
+    class JsonKey;
+
+    class JsonDict;
+
+    class KeyTable;
 
     struct Token;
 
@@ -39,26 +72,134 @@ namespace JSON {
 
     class Parser;
 
-    std::string getIndent(int indent);
+    class Document;
+
+    class MappedFile;
+
+    class Writer;
+
+    struct FormatOptions;
+
+    struct ParseStats;
+
+    struct LazyNode;
+
+    class Path;
+
+    class Handler;
+
+    class PushParser;
+
+    class LineReader;
 
-    std::string formatLine(const std::string &value, int indent, bool end);
+    class LineWriter;
 
-    std::string formatLine(const std::string &key, const std::string &value,
-                           int indent, bool end);
+    class ThreadPool;
+
+    /// <summary>
+    /// How a Document builds its tree. Eager documents are parsed in full up
+    /// front. Lazy documents only find the extent of each array and dictionary,
+    /// parsing one level of it the first time it is accessed, so reading a few
+    /// fields of a large document costs little more than reading those fields.
+    /// Parallel documents are parsed in full, with large arrays and
+    /// dictionaries split between the threads of the shared ThreadPool.
+    /// </summary>
+    enum EParseMode : std::uint8_t {
+        Eager,
+        Lazy,
+        Parallel
+    };
 
     JsonObject loadFile(const std::string &filename);
 
     JsonObject loadString(std::string &string);
 
+    const JsonObject &loadFile(const std::string &filename, Document &document, EParseMode mode = Eager);
+
+    const JsonObject &loadString(std::string_view string, Document &document, EParseMode mode = Eager);
+
+    /// <summary>
+    /// Parses the file `filename` into `document`, adding to `stats`.
+    /// </summary>
+    const JsonObject &loadFile(const std::string &filename, Document &document, ParseStats &stats);
+
+    /// <summary>
+    /// Parses `string` into `document`, adding to `stats`.
+    /// </summary>
+    const JsonObject &loadString(std::string_view string, Document &document, ParseStats &stats);
+
+    /// <summary>
+    /// Parses every file in `filenames` into its own Document, spreading the
+    /// files over `pool` (or the shared ThreadPool if null). Each thread reuses
+    /// one Parser for all the files it parses.
+    /// </summary>
+    /// <returns>The documents, in the order of `filenames`.</returns>
+    std::vector<std::unique_ptr<Document>> loadFiles(std::span<const std::string> filenames, ThreadPool *pool = nullptr);
+
+    /// <summary>
+    /// Parses every file in `filenames` on `pool`, passing each Document to
+    /// `done` with its index as soon as it is parsed. `done` is called on the
+    /// pool's threads, so it must be safe to call concurrently.
+    /// </summary>
+    void loadFiles(std::span<const std::string> filenames,
+                   const std::function<void(size_t, std::unique_ptr<Document>)> &done, ThreadPool *pool = nullptr);
+
+    /// <summary>
+    /// Parses every string in `strings` into its own Document on `pool`. The
+    /// documents copy what they need, so the strings may be freed afterwards.
+    /// </summary>
+    /// <returns>The documents, in the order of `strings`.</returns>
+    std::vector<std::unique_ptr<Document>> loadStrings(std::span<const std::string_view> strings,
+                                                       ThreadPool *pool = nullptr);
+
+    /// <summary>
+    /// Parses every string in `strings` on `pool`, passing each Document to
+    /// `done` with its index as soon as it is parsed.
+    /// </summary>
+    void loadStrings(std::span<const std::string_view> strings,
+                     const std::function<void(size_t, std::unique_ptr<Document>)> &done, ThreadPool *pool = nullptr);
+
+    /// <summary>
+    /// Reads `string`, passing each value to `handler` as it is lexed instead
+    /// of building a tree. Throws on malformed input, including anything but
+    /// whitespace after the root value, which is found after its events.
+    /// </summary>
+    /// <returns>False if the handler stopped reading early.</returns>
+    bool readString(std::string_view string, Handler &handler);
+
+    /// <summary>
+    /// Memory-maps the file `filename` and reads it into `handler`.
+    /// </summary>
+    /// <returns>False if the handler stopped reading early.</returns>
+    bool readFile(const std::string &filename, Handler &handler);
+
     std::ostream &operator<<(std::ostream &o, JsonArray &a);
 
     std::ostream &operator<<(std::ostream &o, JsonDict &d);
 
+    /// <summary>
+    /// Parses the text of a JSON number without allocating. Integers which fit
+    /// in 64 bits become Int (or UInt, above INT64_MAX); numbers with a fraction
+    /// or exponent, and larger integers, become Double.
+    /// </summary>
+    /// <param name="text">The number, e.g. "-12", "3.5e-4".</param>
+    /// <returns>An Int, UInt or Double JsonObject.</returns>
+    JsonObject parseNumber(std::string_view text);
+
+    /// <summary>
+    /// Decodes the escape sequences of the text of a JSON string, without its
+    /// quotes. Text without a backslash is returned as is; otherwise it is
+    /// decoded into `scratch`, and the result views that.
+    /// </summary>
+    /// <param name="text">The string's text, e.g. a\"b\u00e9 for "a\"b\u00e9".</param>
+    /// <returns>The decoded string, as UTF-8.</returns>
+    std::string_view unescapeString(std::string_view text, std::string &scratch);
+
     /// <summary>
     /// JSON value types, with numbers slightly modified for C++.
-    /// Number becomes both Int and Double.
+    /// Number becomes Int, UInt or Double.
     /// </summary>
-    enum EValueType {
+    enum EValueType : std::uint8_t {
         Null, // nullptr
         LBrace,
         RBrace,
@@ -68,142 +209,219 @@ namespace JSON {
         Comma,
         Number,
         Bool,      // true, false
-        Int,       // 1, 2, 3
-        Double,    // 3.14, 7.62, 50.50
+        Int,       // 1, 2, 3 (64-bit)
+        UInt,      // Integers above INT64_MAX, up to UINT64_MAX
+        Double,    // 3.14, 7.62, 50.50, 1e10
         String,    // "This is a string."
         Array,     // { 1, 2, 3, 4, 5 }
-        Dictionary // { {"Key 1", 5}, {"Key 2", 10} }
+        Dictionary, // { {"Key 1", 5}, {"Key 2", 10} }
+        End         // End of input (lexing only)
     };
 
     /// <summary>
-    /// Base class for all JSON value types.
+    /// A dictionary key. Keys of up to 15 characters, which covers most keys in
+    /// practice, are stored inline; longer keys are stored on the heap.
+    ///
+    /// Keys parsed into an arena instead borrow their characters from a
+    /// KeyTable, so each distinct key is stored once per document. Copying a
+    /// borrowed key produces an owned copy.
     /// </summary>
-    class Value {
+    class JsonKey {
+        // Inline characters, or a character pointer followed by a 32-bit length.
+        alignas(8) char m_data[15]{};
+
+        // Length of an inline key, `HEAP_KEY` if the characters are owned on the
+        // heap, or `BORROWED` if they are owned elsewhere.
+        std::uint8_t m_size = 0;
+
+        static constexpr std::uint8_t HEAP_KEY = 0xFF;
+        static constexpr std::uint8_t BORROWED = 0xFE;
+
+        void release();
+
     public:
+        // Keys up to this length are stored inline.
+        static constexpr std::uint8_t SMALL_KEY_SIZE = 15;
+
+        JsonKey() = default;
+
+        JsonKey(std::string_view key);
+
+        JsonKey(const JsonKey &other);
+
+        JsonKey(JsonKey &&other) noexcept : m_size(other.m_size) {
+            std::memcpy(m_data, other.m_data, sizeof(m_data));
+            other.m_size = 0;
+        }
+
+        ~JsonKey() {
+            if (m_size == HEAP_KEY) {
+                release();
+            }
+        }
+
         /// <summary>
-        /// Format the current value to a string.
+        /// Creates a key viewing `key`, which must outlive it.
         /// </summary>
-        /// <returns>The string-formatted value.</returns>
-        virtual std::string format() = 0;
-    };
+        static JsonKey borrow(std::string_view key);
 
-    /// <summary>
-    /// Typedef alias for Value.
-    /// </summary>
-    typedef Value value_t;
+        JsonKey &operator=(const JsonKey &other);
 
-    /// <summary>
-    /// NullType JSON value. Represents the 'null' keyword.
-    /// </summary>
-    class [[maybe_unused]] NullValue : public value_t {
-    public:
-        NullValue() = default;
+        JsonKey &operator=(JsonKey &&other) noexcept;
+
+        [[nodiscard]] std::string_view view() const {
+            if (m_size < SMALL_KEY_SIZE + 1) {
+                return {m_data, m_size};
+            }
+            const char *data;
+            std::uint32_t size;
+            std::memcpy(&data, m_data, sizeof(data));
+            std::memcpy(&size, m_data + sizeof(data), sizeof(size));
+            return {data, size};
+        }
 
-        std::string format() override;
+        [[nodiscard]] const char *data() const { return view().data(); }
 
-        std::ostream &operator<<(std::ostream &o);
+        [[nodiscard]] size_t size() const { return view().size(); }
+
+        operator std::string_view() const { return view(); }
+
+        friend bool operator==(const JsonKey &a, const JsonKey &b) { return a.view() == b.view(); }
+
+        friend bool operator==(const JsonKey &a, std::string_view b) { return a.view() == b; }
+
+        friend std::strong_ordering operator<=>(const JsonKey &a, const JsonKey &b) {
+            return a.view() <=> b.view();
+        }
     };
 
     /// <summary>
-    /// Boolean JSON value. Represents the 'true' and 'false' keywords.
+    /// Key/value storage for dictionaries. Entries are kept in a flat vector in
+    /// insertion order, so iteration is sequential and documents keep their key
+    /// order when written back out. Small dictionaries are searched linearly;
+    /// once a dictionary reaches `HASH_THRESHOLD` keys an open addressing hash
+    /// index over the entries is kept as well, so lookups stay O(1).
+    ///
+    /// As with std::vector, inserting may invalidate references to values.
     /// </summary>
-    class BoolValue : public value_t {
-        bool m_value{};
-
+    class JsonDict {
     public:
-        explicit BoolValue(bool value) : m_value(value) {
-        };
+        typedef std::pair<JsonKey, JsonObject> value_type;
+        typedef std::pmr::polymorphic_allocator<value_type> allocator_type;
+        typedef std::pmr::vector<value_type>::iterator iterator;
+        typedef std::pmr::vector<value_type>::const_iterator const_iterator;
 
-        BoolValue(const BoolValue &other);
+        // Dictionaries with at least this many keys are given a hash index.
+        static constexpr size_t HASH_THRESHOLD = 8;
 
-        [[nodiscard]] bool value() const;
+    private:
+        std::pmr::vector<value_type> m_entries;
 
-        std::string format() override;
+        // Open addressing (linear probing) table of entry index + 1, with 0
+        // marking an empty slot. Empty below `HASH_THRESHOLD` keys.
+        std::pmr::vector<std::uint32_t> m_index;
 
-        std::ostream &operator<<(std::ostream &o);
-    };
+        [[nodiscard]] size_t lookup(std::string_view key) const;
 
-    /// <summary>
-    /// Number JSON value. Represents numbers which have no decimals (integers).
-    /// </summary>
-    class IntValue : public value_t {
-        int m_value{};
+        void insertIndex(size_t entry);
+
+        void rebuildIndex();
+
+        void append(JsonKey &&key, JsonObject &&value);
 
     public:
-        explicit IntValue(int value) : m_value(value) {
-        };
+        JsonDict();
 
-        IntValue(const IntValue &other);
+        explicit JsonDict(const allocator_type &allocator);
 
-        [[nodiscard]] int value() const;
+        JsonDict(std::initializer_list<std::pair<std::string_view, JsonObject>> values);
 
-        std::string format() override;
+        JsonDict(const JsonDict &other);
 
-        std::ostream &operator<<(std::ostream &o);
-    };
+        JsonDict(const JsonDict &other, const allocator_type &allocator);
 
-    /// <summary>
-    /// Number JSON value. Represents numbers which have decimals.
-    /// </summary>
-    class DoubleValue : public value_t {
-        double m_value{};
+        JsonDict(JsonDict &&other) noexcept;
 
-    public:
-        explicit DoubleValue(double value) : m_value(value) {
-        };
+        ~JsonDict();
 
-        DoubleValue(const DoubleValue &other);
+        JsonDict &operator=(const JsonDict &other);
 
-        [[nodiscard]] double value() const;
+        JsonDict &operator=(JsonDict &&other);
 
-        std::string format() override;
+        [[nodiscard]] allocator_type get_allocator() const;
 
-        std::ostream &operator<<(std::ostream &o);
-    };
+        [[nodiscard]] size_t size() const;
 
-    /// <summary>
-    /// StringType JSON value. Does not contain wrapped quotes, they are not
-    /// necessary because of the defined type.
-    /// </summary>
-    class StringValue : public value_t {
-        std::string m_value;
+        [[nodiscard]] bool empty() const;
 
-    public:
-        explicit StringValue(std::string &value) : m_value(value) {
-        };
+        iterator begin();
 
-        explicit StringValue(const std::basic_string<char> &value) : m_value(value) {
-        };
+        iterator end();
 
-        StringValue(StringValue const &other);
+        [[nodiscard]] const_iterator begin() const;
 
-        std::string value();
+        [[nodiscard]] const_iterator end() const;
 
-        std::string format() override;
+        iterator find(std::string_view key);
 
-        std::ostream &operator<<(std::ostream &o);
+        [[nodiscard]] const_iterator find(std::string_view key) const;
+
+        [[nodiscard]] bool contains(std::string_view key) const;
+
+        /// <summary>
+        /// Returns the value for `key`, appending a Null value if it is missing.
+        /// </summary>
+        JsonObject &operator[](std::string_view key);
+
+        /// <summary>
+        /// Sets the value for `key`, appending it if it is missing and otherwise
+        /// keeping its original position.
+        /// </summary>
+        /// <returns>The entry, and whether it was newly inserted.</returns>
+        std::pair<iterator, bool> insert_or_assign(std::string_view key, JsonObject value);
+
+        std::pair<iterator, bool> insert_or_assign(JsonKey &&key, JsonObject value);
+
+        /// <summary>
+        /// Removes `key`, keeping the order of the remaining entries.
+        /// </summary>
+        /// <returns>The number of entries removed.</returns>
+        size_t erase(std::string_view key);
+
+        void reserve(size_t size);
+
+        void clear();
     };
 
     /// <summary>
     /// Array JSON value. Contains a single array of [JsonObject, ...].
-    /// This is defined with the typedef JsonArray.
+    /// This is defined with the typedef JsonArray. Array JsonObjects hold a
+    /// pointer to one of these.
     /// </summary>
-    class ArrayValue : public value_t {
+    class ArrayValue {
         JsonArray m_value;
 
     public:
         explicit ArrayValue(const JsonArray &value);
 
+        explicit ArrayValue(JsonArray &&value);
+
         ArrayValue(const ArrayValue &other);
 
+        ArrayValue(ArrayValue &&other) noexcept;
+
         JsonArray value();
 
+        [[nodiscard]] const JsonArray &ref() const;
+
         JsonArray *ptr();
 
-        std::string format() override;
+        std::string format();
 
         ArrayValue &operator=([[maybe_unused]] const ArrayValue &other);
 
+        ArrayValue &operator=(ArrayValue &&other) noexcept;
+
         JsonObject &operator[](int index);
 
         std::ostream &operator<<(std::ostream &o);
@@ -212,37 +430,132 @@ namespace JSON {
     };
 
     /// <summary>
-    /// Array JSON value. Contains a single map of {{std::string, JsonObject}, ...}.
-    /// This is defined with the typedef JsonDict.
+    /// Dictionary JSON value. Contains a single set of {{std::string, JsonObject}, ...}.
+    /// This is defined with the typedef JsonDict. Dictionary JsonObjects hold a
+    /// pointer to one of these.
     /// </summary>
-    class DictValue : public value_t {
+    class DictValue {
         JsonDict m_value;
 
     public:
         explicit DictValue(const JsonDict &value);
 
+        explicit DictValue(JsonDict &&value);
+
         DictValue(const DictValue &other);
 
+        DictValue(DictValue &&other) noexcept;
+
         JsonDict value();
 
+        [[nodiscard]] const JsonDict &ref() const;
+
         JsonDict *ptr();
 
-        std::string format() override;
+        std::string format();
 
         DictValue &operator=(const DictValue &other);
 
-        JsonObject &operator[](const std::string &key);
+        DictValue &operator=(DictValue &&other) noexcept;
+
+        JsonObject &operator[](std::string_view key);
 
         friend std::ostream &operator<<(std::ostream &o, DictValue &d);
     };
 
     /// <summary>
-    /// Base JSON object. Contains a wrapper for each possible value type, with
-    /// constructors and accessors for each.
+    /// Base JSON object. A compact 16 byte tagged union holding any JSON value
+    /// type, with constructors and accessors for each.
+    ///
+    /// Bools, numbers and strings of up to 14 characters are stored inline.
+    /// Longer strings, arrays and dictionaries are stored on the heap and the
+    /// JsonObject holds a pointer to them, so arrays of scalars are contiguous.
+    ///
+    /// JsonObjects parsed into a Document instead borrow their payload from the
+    /// Document's arena; copying one of these produces a heap-owned copy.
+    ///
+    /// Arrays and dictionaries of a lazy Document point to a LazyNode until they
+    /// are first accessed. Accessing them parses them, so lazy trees must not be
+    /// read from several threads at once. Writers formatting on a ThreadPool
+    /// parse them on the calling thread before splitting the work.
     /// </summary>
     class JsonObject {
-        std::unique_ptr<value_t> m_value;
-        EValueType m_type;
+        friend class Parser;
+        friend class PushParser;
+        friend class Writer;
+
+        // Inline payload: a scalar, a short string's characters, or a pointer to
+        // the heap-allocated std::string, ArrayValue or DictValue. Borrowed
+        // strings store a character pointer followed by a 32-bit length.
+        alignas(8) char m_data[14]{};
+
+        // Length of an inline string, `HEAP_STRING` if the string is stored on
+        // the heap, `BORROWED` if the payload is owned by an arena, or `LAZY` if
+        // the payload is an arena LazyNode which has yet to be parsed.
+        std::uint8_t m_size = 0;
+
+        EValueType m_type = EValueType::Null;
+
+        static constexpr std::uint8_t SMALL_STRING_SIZE = sizeof(m_data);
+        static constexpr std::uint8_t HEAP_STRING = 0xFF;
+        static constexpr std::uint8_t BORROWED = 0xFE;
+        static constexpr std::uint8_t LAZY = 0xFD;
+
+        template<typename T>
+        [[nodiscard]] T load(size_t offset = 0) const {
+            T value;
+            std::memcpy(&value, m_data + offset, sizeof(T));
+            return value;
+        }
+
+        template<typename T>
+        void store(T value, size_t offset = 0) {
+            std::memcpy(m_data + offset, &value, sizeof(T));
+        }
+
+        /// <summary>
+        /// Builds a String, Array or Dictionary whose payload is allocated from
+        /// `arena` and borrowed rather than owned. If `arena` is nullptr, the
+        /// payload is heap-allocated and owned as usual.
+        /// </summary>
+        static JsonObject makeString(std::string_view value, std::pmr::memory_resource *arena);
+
+        /// <summary>
+        /// Builds a String which borrows `value`'s characters rather than copying
+        /// them. The characters must outlive the JsonObject.
+        /// </summary>
+        static JsonObject makeStringView(std::string_view value);
+
+        static JsonObject makeArray(JsonArray &&value, std::pmr::memory_resource *arena);
+
+        static JsonObject makeDict(JsonDict &&value, std::pmr::memory_resource *arena);
+
+        /// <summary>
+        /// Builds an Array or Dictionary which is parsed from `node` on access.
+        /// </summary>
+        static JsonObject makeLazy(EValueType type, LazyNode *node);
+
+        /// <summary>
+        /// Stores the given string inline if it is short enough, otherwise on
+        /// the heap, and sets the type to String.
+        /// </summary>
+        void setString(std::string_view value);
+
+        /// <summary>
+        /// Frees any owned heap payload and resets this JsonObject to Null.
+        /// </summary>
+        void release();
+
+        /// <summary>
+        /// Steals the payload of `other`, leaving it Null.
+        /// </summary>
+        void take(JsonObject &other) noexcept;
+
+        /// <summary>
+        /// If this is a lazy Array or Dictionary, parses it and every container
+        /// in it, so that the tree can then be read from several threads.
+        /// </summary>
+        void expandLazy() const;
 
         // https://www.internalpointers.com/post/writing-custom-iterators-modern-cpp
         struct Iterator {
@@ -285,28 +598,27 @@ namespace JSON {
         // Constructors
         JsonObject();                                  // Default
         JsonObject(const JsonObject &other);           // Copy
+        JsonObject(JsonObject &&other) noexcept;       // Move
+        ~JsonObject();
         explicit JsonObject(bool value);               // Bool
         explicit JsonObject(int value);                // Integer
+        explicit JsonObject(std::int64_t value);       // Integer (64-bit)
+        explicit JsonObject(std::uint64_t value);      // Unsigned integer (64-bit)
         explicit JsonObject(double value);             // Double
         explicit JsonObject(const std::string &value); // StringType
+        explicit JsonObject(std::string &&value);      // StringType (moved)
         explicit JsonObject(const JsonArray &value);   // Array
+        explicit JsonObject(JsonArray &&value);        // Array (moved)
         explicit JsonObject(const JsonDict &value);    // Dictionary
+        explicit JsonObject(JsonDict &&value);         // Dictionary (moved)
 
         /// <summary>
         /// Returns the EValueType of this JsonObject.
         /// </summary>
-        EValueType type() {
+        [[nodiscard]] EValueType type() const {
             return m_type;
         }
 
-        [[nodiscard]] BoolValue &asBool() const;
-
-        [[nodiscard]] IntValue &asInt() const;
-
-        [[nodiscard]] DoubleValue &asDouble() const;
-
-        [[nodiscard]] StringValue &asString() const;
-
         [[nodiscard]] ArrayValue &asArray() const;
 
         [[nodiscard]] DictValue &asDict() const;
@@ -315,6 +627,10 @@ namespace JSON {
 
         [[nodiscard]] int getInt() const;
 
+        [[nodiscard]] std::int64_t getInt64() const;
+
+        [[nodiscard]] std::uint64_t getUInt64() const;
+
         [[nodiscard]] double getDouble() const;
 
         [[nodiscard]] std::string getString() const;
@@ -323,20 +639,61 @@ namespace JSON {
 
         [[nodiscard]] JsonDict getDict() const;
 
+        // Non-copying accessors. These return views into this JsonObject, which
+        // are only valid for as long as it is alive and unmodified.
+        [[nodiscard]] std::string_view getStringView() const;
+
+        [[nodiscard]] const JsonArray &getArrayRef() const;
+
+        [[nodiscard]] std::span<const JsonObject> getArraySpan() const;
+
+        [[nodiscard]] const JsonDict &getDictRef() const;
+
         /// <summary>
         /// Formats this JsonObject as a std::string.
         /// </summary>
         [[nodiscard]] std::string format() const;
 
-        bool hasKey(const std::string &key);
+        [[nodiscard]] std::string format(const FormatOptions &options) const;
 
-        size_t size();
+        /// <summary>
+        /// Formats this value, adding the time taken and the output size to `stats`.
+        /// </summary>
+        [[nodiscard]] std::string format(const FormatOptions &options, ParseStats &stats) const;
+
+        [[nodiscard]] bool hasKey(std::string_view key) const;
+
+        /// <summary>
+        /// Returns a pointer to the value at `key`, or nullptr if this
+        /// Dictionary does not contain it. Unlike operator[], this never throws
+        /// on a missing key.
+        /// </summary>
+        [[nodiscard]] const JsonObject *find(std::string_view key) const;
+
+        JsonObject *find(std::string_view key);
+
+        [[nodiscard]] size_t size() const;
 
+        /// <summary>
+        /// Iterates the elements of an Array. Dictionaries hold key/value
+        /// pairs, so they are iterated through asDict().ref() instead.
+        /// </summary>
         Iterator begin() {
             if (m_type == Array) {
-                return Iterator(&asArray()[0]);
+                return Iterator(asArray().ptr()->data());
+            } else if (m_type == Dictionary) {
+                throw std::runtime_error("Dictionaries are iterated through asDict().ref().");
+            } else {
+                throw std::runtime_error("Invalid type for range.");
+            }
+        };
+
+        Iterator end() {
+            if (m_type == Array) {
+                JsonArray *array = asArray().ptr();
+                return Iterator(array->data() + array->size());
             } else if (m_type == Dictionary) {
-                return Iterator(&asDict()[0]);
+                throw std::runtime_error("Dictionaries are iterated through asDict().ref().");
             } else {
                 throw std::runtime_error("Invalid type for range.");
             }
@@ -345,10 +702,16 @@ namespace JSON {
         // Operators
         JsonObject &operator=(const JsonObject &other);
 
-        JsonObject &operator[](const std::string &key);
+        JsonObject &operator=(JsonObject &&other) noexcept;
+
+        JsonObject &operator[](std::string_view key);
+
+        const JsonObject &operator[](std::string_view key) const;
 
         JsonObject &operator[](int index);
 
+        const JsonObject &operator[](int index) const;
+
         friend std::ostream &operator<<(std::ostream &o, JsonObject &j);
 
         friend std::ostream &operator<<(std::ostream &o, const JsonObject &j);
@@ -358,102 +721,1030 @@ namespace JSON {
 
         explicit operator int() const;
 
+        explicit operator std::int64_t() const;
+
+        explicit operator std::uint64_t() const;
+
         explicit operator double() const;
 
         explicit operator std::string() const;
 
+        explicit operator std::string_view() const;
+
         explicit operator JsonArray() const;
 
         explicit operator JsonDict() const;
     };
 
+    static_assert(sizeof(JsonObject) == 16, "JsonObject should stay 16 bytes");
+
     /// <summary>
-    /// Token struct for lexing.
+    /// Options controlling how JSON is serialized.
     /// </summary>
-    struct Token {
-        EValueType type = EValueType::Null;
-        std::string value;
+    struct FormatOptions {
+        // Whether to write new lines and indentation. When false, output is
+        // minified with no whitespace at all.
+        bool pretty = true;
+
+        // The number of spaces per level of indentation when pretty printing.
+        int indentWidth = 4;
+
+        // Whether to write dictionary keys in sorted order rather than the
+        // order they are stored in.
+        bool sortKeys = false;
+
+        // The pool to write the elements of large arrays and dictionaries on
+        // in parallel, or nullptr to write everything on the calling thread.
+        // The output is the same either way.
+        ThreadPool *pool = nullptr;
     };
 
     /// <summary>
-    /// Lexer for tokenizing the given input string. By default, the input string
-    /// will be sanitized (removing whitespace, new lines, returns, end of file,
-    /// etc.)
+    /// Where the time and memory of parsing and formatting went, for
+    /// diagnosing slow requests. Calls taking a ParseStats add to it rather
+    /// than overwriting it, so one ParseStats can follow a request through
+    /// several calls.
+    ///
+    /// Statistics are only collected when built with JSON_ENABLE_STATS set to
+    /// true; otherwise every field stays 0, and nothing is measured.
     /// </summary>
-    class Lexer {
-        std::string m_string;
-        int m_offset = 0;
+    struct ParseStats {
+        static constexpr bool ENABLED = JSON_ENABLE_STATS;
+
+        // Time spent mapping (or reading) files, lexing and building trees, and
+        // formatting, in nanoseconds. Lexing happens as the parser pulls each
+        // token, so it is timed as part of parsing.
+        std::uint64_t readNs = 0;
+        std::uint64_t parseNs = 0;
+        std::uint64_t formatNs = 0;
+
+        // The size of the input parsed, and of the output formatted.
+        std::uint64_t bytes = 0;
+        std::uint64_t formattedBytes = 0;
+
+        // The number of tokens lexed, and of values (nodes) parsed.
+        std::uint64_t tokens = 0;
+        std::uint64_t nodes = 0;
+
+        // Blocks a Document's arena allocated for its tree, and their total size.
+        std::uint64_t allocations = 0;
+        std::uint64_t allocatedBytes = 0;
+
+        // The deepest nesting of arrays and dictionaries.
+        std::uint32_t maxDepth = 0;
+    };
 
-        /// <summary>
-        /// Sanitizes the given input string. This will remove new lines, end of
-        /// lines, and whitespace outside of strings.
-        /// </summary>
-        /// <param name="input">The input string to sanitize.</param>
-        /// <returns>The sanitized string.</returns>
-        static std::string sanitize(std::string &input);
+#if JSON_ENABLE_STATS == true
+    /// <summary>
+    /// Memory resource which passes allocations to another, counting them into
+    /// a ParseStats while one is set.
+    /// </summary>
+    class CountingResource : public std::pmr::memory_resource {
+        std::pmr::memory_resource *m_upstream;
+        ParseStats *m_stats = nullptr;
 
-    public:
-        std::vector<Token> tokens;
+        void *do_allocate(size_t bytes, size_t alignment) override;
 
-        explicit Lexer(std::string string);;
+        void do_deallocate(void *p, size_t bytes, size_t alignment) override;
 
-        /// <summary>
-        /// Determines if we can continue tokenization if the current character
-        /// position is not at the end of the sanitized string.
-        /// </summary>
-        bool canContinue();
+        [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
 
-        /// <summary>
-        /// Determines the next token and adds it to the array of tokens. This will
-        /// increment `m_offset` by however long the token is determined to be.
-        /// </summary>
-        /// <returns>The token which is constructed.</returns>
-        Token next();
+    public:
+        explicit CountingResource(std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+
+        void setStats(ParseStats *stats);
     };
+#endif
 
     /// <summary>
-    /// Parser which ingests a Lexer (essentially a list of tokens) and builds an
-    /// Abstract Syntax Tree (AST) from it. The final output of this AST is a
-    /// JsonObject itself.
+    /// Serializes JSON values in a single pass, appending directly to an output
+    /// string, or to an internal buffer which is flushed to an std::ostream
+    /// whenever it grows past `FLUSH_SIZE`. Indentation is copied from a
+    /// pre-computed run of spaces rather than built per line.
+    ///
+    /// All formatting state lives in the Writer, so separate Writers can be
+    /// used from separate threads at once.
     /// </summary>
-    class Parser {
-        // The lexer which contains the tokens to parse.
-        Lexer *m_lexer;
+    class Writer {
+        friend class LineWriter;
 
-        // The output JsonObject.
-        JsonObject m_json;
+        // Buffered output when writing to a stream.
+        std::string m_buffer;
 
-        // The current token pointer.
-        Token *current;
+        // Where output is appended: the caller's string, or `m_buffer`.
+        std::string *m_output;
 
-        // The current token position.
-        int pos = 0;
+        // The stream `m_buffer` is flushed to, if any.
+        std::ostream *m_stream = nullptr;
+
+        FormatOptions m_options;
+
+        // Scratch list of dictionary entries used when sorting keys.
+        std::vector<const JsonDict::value_type *> m_entries;
+
+        static constexpr size_t FLUSH_SIZE = 64 * 1024;
+
+        // Containers with fewer elements than this are always written on the
+        // calling thread, and parallel writes give each task at least
+        // `PARALLEL_MIN_CHUNK` elements.
+        static constexpr size_t PARALLEL_MIN_ELEMENTS = 8192;
+        static constexpr size_t PARALLEL_MIN_CHUNK = 1024;
+
+        void writeIndent(int depth);
+
+        void writeValue(const JsonObject &value, int depth);
+
+        void writeNumber(double value);
 
         /// <summary>
-        /// Iterate to the next token as well as bump the position by 1.
+        /// Writes `text` in quotes, escaping quotes, backslashes and control
+        /// characters.
         /// </summary>
-        void next();
+        void writeString(std::string_view text);
 
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "misc-no-recursion"
+        template<typename T>
+        void writeInteger(T value);
+
+        void writeArray(const JsonArray &array, int depth);
+
+        void writeDict(const JsonDict &dict, int depth);
 
         /// <summary>
-        /// Recursively parse the current token. Assuming the JSON string is valid and
-        /// begins with either a dictionary or an array, the first token will begin
-        /// the recursion.
+        /// Writes elements `first` to `last` of `array`, with their separators.
         /// </summary>
-        /// <returns></returns>
-        JsonObject parse();
+        void writeElements(const JsonArray &array, size_t first, size_t last, int depth);
 
-#pragma clang diagnostic pop
+        /// <summary>
+        /// Writes entries `first` to `last` of `dict`, with their separators,
+        /// in the order of `sorted` from `base` when keys are sorted.
+        /// </summary>
+        void writeEntries(const JsonDict &dict, const std::vector<const JsonDict::value_type *> &sorted, size_t base,
+                          size_t first, size_t last, int depth);
+
+        /// <summary>
+        /// Splits the elements of `container` into chunks which `write` renders
+        /// into their own Writers on the pool, then appends the chunks in order.
+        /// Lazy elements are parsed first, on this thread. Returns false,
+        /// writing nothing, if there is no pool or too few elements to be worth
+        /// splitting.
+        /// </summary>
+        template<typename Container, typename Write>
+        bool writeParallel(const Container &container, const Write &write);
+
+        /// <summary>
+        /// Flushes the buffer to the stream if it has grown past `FLUSH_SIZE`.
+        /// </summary>
+        void checkFlush();
 
     public:
-        explicit Parser(Lexer *lexer);
+        /// <summary>
+        /// Creates a Writer which appends to `output`.
+        /// </summary>
+        explicit Writer(std::string &output, const FormatOptions &options = {});
 
         /// <summary>
-        /// Returns the JsonObject which was parsed from the file (or string).
+        /// Creates a Writer which writes to `stream` through a bounded buffer.
         /// </summary>
-        JsonObject &get();
+        explicit Writer(std::ostream &stream, const FormatOptions &options = {});
+
+        Writer(const Writer &other) = delete;
+
+        Writer &operator=(const Writer &other) = delete;
+
+        ~Writer();
+
+        void write(const JsonObject &value);
+
+        void write(const JsonArray &value);
+
+        void write(const JsonDict &value);
+
+        /// <summary>
+        /// Writes any buffered output to the stream.
+        /// </summary>
+        void flush();
+    };
+
+    /// <summary>
+    /// Token struct for lexing. Tokens do not own their text; they refer to a
+    /// range of the source string held by the Lexer. For strings the range
+    /// excludes the surrounding quotes.
+    /// </summary>
+    struct Token {
+        EValueType type = EValueType::Null;
+        size_t offset = 0;
+        size_t length = 0;
+    };
+
+    /// <summary>
+    /// Where `Lexer::scanElements` stopped: after a comma past its end offset,
+    /// at a large array or dictionary, or at the end of the enclosing container.
+    /// </summary>
+    struct ElementScan {
+        size_t count = 0;                          // Elements passed
+        size_t element = 0;                        // Offset of the last element started
+        size_t container = std::string_view::npos; // Offset of a large container, if found
+        bool closed = false;                       // Whether the enclosing container ended
+    };
+
+    /// <summary>
+    /// Bitmaps classifying each byte of a 64 byte block of input, where bit `i`
+    /// describes byte `i` of the block.
+    /// </summary>
+    struct BlockMasks {
+        std::uint64_t quote = 0;      // Quotes
+        std::uint64_t backslash = 0;  // Backslashes
+        std::uint64_t whitespace = 0; // Spaces, tabs, new lines, returns, nulls
+        std::uint64_t structural = 0; // { } [ ] : ,
+        std::uint64_t open = 0;       // { [
+        std::uint64_t close = 0;      // } ]
+    };
+
+    /// <summary>
+    /// Classifies the 64 bytes starting at `block`. This is vectorized with the
+    /// widest instruction set the CPU supports at runtime (AVX2 or SSE4.2 on
+    /// x86-64), falling back to scalar code elsewhere.
+    /// </summary>
+    void classifyBlock(const char *block, BlockMasks &masks);
+
+    /// <summary>
+    /// Returns the name of the instruction set `classifyBlock` uses on this CPU.
+    /// </summary>
+    const char *classifyInstructionSet();
+
+    /// <summary>
+    /// Lexer for tokenizing the given input string. The input is walked once,
+    /// skipping whitespace outside of strings inline, and is never copied: the
+    /// caller must keep the source string alive for as long as the Lexer (and
+    /// its tokens) are in use.
+    ///
+    /// Tokens are produced on demand by `next()` rather than collected up front,
+    /// so tokenization costs constant memory regardless of the input size.
+    /// </summary>
+    class Lexer {
+        std::string_view m_string;
+        size_t m_offset = 0;
+
+        // The classified 64 byte block of the input at `m_blockOffset`. Blocks
+        // are classified at most once each, when the lexer first reaches them.
+        BlockMasks m_masks;
+        size_t m_blockOffset = std::string_view::npos;
+
+        /// <summary>
+        /// Returns the masks of the block containing `offset`, classifying it if
+        /// it is not the current block.
+        /// </summary>
+        const BlockMasks &masksAt(size_t offset);
+
+        /// <summary>
+        /// Advances `m_offset` past any whitespace (spaces, tabs, new lines,
+        /// returns and null characters).
+        /// </summary>
+        void skipWhitespace();
+
+        /// <summary>
+        /// Returns the offset of the first quote or backslash at or after
+        /// `offset`, or the size of the input if there is none.
+        /// </summary>
+        size_t findQuoteOrBackslash(size_t offset);
+
+    public:
+        /// <summary>
+        /// Creates a Lexer over `string`, starting at `offset`.
+        /// </summary>
+        explicit Lexer(std::string_view string, size_t offset = 0);
+
+        /// <summary>
+        /// Returns the whole input string.
+        /// </summary>
+        [[nodiscard]] std::string_view source() const;
+
+        /// <summary>
+        /// Returns the offset just past the last token returned.
+        /// </summary>
+        [[nodiscard]] size_t offset() const;
+
+        /// <summary>
+        /// Skips the array or dictionary opened by the token `open`, which must be
+        /// the last token returned, by matching brackets outside of strings a
+        /// block at a time. The skipped contents are not validated.
+        /// </summary>
+        void skipContainer(const Token &open);
+
+        /// <summary>
+        /// Passes over the elements of a container from `offset`, the start of
+        /// one of its elements, by matching brackets and counting commas outside
+        /// of strings a block at a time, without tokenizing the elements. Stops
+        /// after the first comma at or past `end`, after an element holding an
+        /// array or dictionary of at least `large` bytes (which is not counted),
+        /// or after the container's closing bracket. The elements are not
+        /// validated.
+        /// </summary>
+        ElementScan scanElements(size_t offset, size_t end, size_t large, bool dict);
+
+        /// <summary>
+        /// Determines if we can continue tokenization if the current character
+        /// position (after any whitespace) is not at the end of the string.
+        /// </summary>
+        bool canContinue();
+
+        /// <summary>
+        /// Returns the text of the given token as a view into the source string.
+        /// </summary>
+        [[nodiscard]] std::string_view value(const Token &token) const;
+
+        /// <summary>
+        /// Determines the next token. This will increment `m_offset` by however
+        /// long the token is determined to be. Once the input is exhausted, every
+        /// call returns a token of type `End`.
+        /// </summary>
+        /// <returns>The token which is constructed.</returns>
+        Token next();
+    };
+
+    /// <summary>
+    /// Interns dictionary keys while parsing into an arena. Documents made of
+    /// arrays of records repeat the same few keys many times; each distinct key
+    /// is stored in the arena once, and every dictionary borrows it from there.
+    /// </summary>
+    class KeyTable {
+        struct Slot {
+            const char *data = nullptr; // nullptr marks an empty slot
+            std::uint32_t size = 0;
+            std::uint32_t hash = 0;
+        };
+
+        // Open addressing (linear probing) table, kept at most half full.
+        std::vector<Slot> m_slots;
+
+        // The indices of the occupied slots, so clearing costs the number of
+        // keys rather than the size the table grew to for the largest document.
+        std::vector<std::uint32_t> m_used;
+
+        void grow();
+
+    public:
+        /// <summary>
+        /// Returns the interned copy of `key`, adding it if it is new. New keys
+        /// are copied into `arena`, or used as-is if `borrow` is true.
+        /// </summary>
+        std::string_view intern(std::string_view key, std::pmr::memory_resource *arena, bool borrow);
+
+        [[nodiscard]] size_t size() const;
+
+        /// <summary>
+        /// Forgets all keys, keeping the table's capacity.
+        /// </summary>
+        void clear();
+    };
+
+    /// <summary>
+    /// Parser which pulls tokens from a Lexer one at a time and builds an
+    /// Abstract Syntax Tree (AST) from them. The final output of this AST is a
+    /// JsonObject itself.
+    ///
+    /// A Parser can be reused: each call to `parse()` resets it and parses a new
+    /// document, keeping the capacity of its scratch buffers so that parsing
+    /// many documents with one Parser does not grow the heap.
+    /// </summary>
+    class Parser {
+        // The range of sizes of the runs of a parallel parse.
+        static constexpr size_t PARALLEL_MIN_CHUNK = 64 * 1024;
+        static constexpr size_t PARALLEL_MAX_CHUNK = 4 * 1024 * 1024;
+
+        // The lexer which produces the tokens to parse.
+        Lexer m_lexer;
+
+        // The arena to allocate strings and containers from, or nullptr to
+        // allocate them on the heap.
+        std::pmr::memory_resource *m_arena = nullptr;
+
+        // Whether long strings borrow their characters from the source string
+        // instead of being copied.
+        bool m_borrow = false;
+
+        // The output JsonObject.
+        JsonObject m_json;
+
+        // The current (lookahead) token.
+        Token m_current;
+
+        // Scratch stack of array elements and dictionary values which have been
+        // parsed but not yet moved into their container. Its capacity is kept
+        // between documents.
+        std::vector<JsonObject> m_stack;
+
+        // Scratch stack of the keys matching values on `m_stack` while parsing
+        // dictionaries. These view the source string, `m_keyTable` when
+        // parsing into an arena, or `m_decodedKeys` for escaped keys.
+        std::vector<std::string_view> m_keys;
+
+        // Interned keys of the document being parsed into an arena.
+        KeyTable m_keyTable;
+
+        // Scratch buffer which escaped strings and keys are decoded into.
+        std::string m_scratch;
+
+        // Decoded copies of escaped keys when parsing without an arena, since
+        // `m_scratch` is reused before the dictionary is built.
+        std::pmr::monotonic_buffer_resource m_decodedKeys;
+
+        // Whether arrays and dictionaries are left as LazyNodes, and whether the
+        // next one should be parsed regardless (when expanding a LazyNode).
+        bool m_lazy = false;
+        bool m_expand = false;
+
+#if JSON_ENABLE_STATS == true
+        // Where to count tokens, nodes and depth, if anywhere, and the depth of
+        // the value being parsed.
+        ParseStats *m_stats = nullptr;
+        std::uint32_t m_depth = 0;
+#endif
+
+        /// <summary>
+        /// Pull the next token from the lexer into `m_current`.
+        /// </summary>
+        void next();
+
+        /// <summary>
+        /// Throws unless the current token is the end of the input, so that
+        /// nothing but whitespace follows the root value.
+        /// </summary>
+        void expectEnd();
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+        /// <summary>
+        /// Recursively parse the current token. Assuming the JSON string is valid and
+        /// begins with either a dictionary or an array, the first token will begin
+        /// the recursion.
+        /// </summary>
+        /// <returns></returns>
+        JsonObject parseValue();
+
+#pragma clang diagnostic pop
+
+        /// <summary>
+        /// Decodes the key `text`, which views the source, and interns or copies
+        /// it so that it outlives the following tokens.
+        /// </summary>
+        std::string_view storeKey(std::string_view text);
+
+        /// <summary>
+        /// Skips the array or dictionary at the current token, returning a lazy
+        /// JsonObject which parses it on access.
+        /// </summary>
+        JsonObject skipLazy(EValueType type);
+
+        /// <summary>
+        /// Parses `count` consecutive array elements, or dictionary entries,
+        /// starting at `offset` in `string`, onto `values` (and their keys onto
+        /// `keys`). Long keys are interned in `arena`.
+        /// </summary>
+        void parseRun(std::string_view string, size_t offset, size_t count, bool dict,
+                      std::pmr::memory_resource *arena, bool borrow, std::vector<JsonObject> &values,
+                      std::vector<std::string_view> &keys);
+
+    public:
+        Parser();
+
+        /// <summary>
+        /// Parses the remaining input of `lexer` immediately.
+        /// </summary>
+        explicit Parser(Lexer *lexer, std::pmr::memory_resource *arena = nullptr);
+
+        /// <summary>
+        /// Resets the parser and parses `string`. Strings and containers are
+        /// allocated from `arena` if one is given (see Document), otherwise on
+        /// the heap. The source string only needs to outlive this call, unless
+        /// `borrow` is set: then long strings are views into the source, which
+        /// must outlive the result.
+        /// </summary>
+        /// <returns>The parsed JsonObject, as returned by `get()`.</returns>
+        JsonObject &parse(std::string_view string, std::pmr::memory_resource *arena = nullptr,
+                          bool borrow = false);
+
+        /// <summary>
+        /// Resets the parser and lazily parses `string` into `arena`. Arrays and
+        /// dictionaries are parsed by this Parser when first accessed, so both it
+        /// and the source string must outlive the result.
+        /// </summary>
+        JsonObject &parseLazy(std::string_view string, std::pmr::memory_resource *arena, bool borrow = false);
+
+        /// <summary>
+        /// Resets the parser and parses `string` into `arena` as `parse()` does,
+        /// except that large arrays and dictionaries are split into runs of
+        /// elements which are parsed on `pool`. Each run is parsed into a new
+        /// arena added to `arenas`, which must outlive the result. Small inputs
+        /// are parsed on the calling thread.
+        /// </summary>
+        JsonObject &parseParallel(std::string_view string, std::pmr::memory_resource *arena, bool borrow,
+                                  ThreadPool &pool,
+                                  std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> &arenas);
+
+        /// <summary>
+        /// Parses one level of the array or dictionary of `node`, from a lazy parse.
+        /// </summary>
+        JsonObject expand(const LazyNode &node);
+
+        /// <summary>
+        /// Drops the last parsed JsonObject, keeping scratch buffer capacity.
+        /// </summary>
+        void reset();
+
+        /// <summary>
+        /// Returns the JsonObject which was parsed from the file (or string).
+        /// Callers which no longer need the parser can move the result out with
+        /// `std::move(parser.get())` rather than copying the tree.
+        /// </summary>
+        JsonObject &get();
+
+        /// <summary>
+        /// Counts the tokens, nodes and depth of the following parses into
+        /// `stats`, or stops counting if it is nullptr. Does nothing unless built
+        /// with JSON_ENABLE_STATS.
+        /// </summary>
+        void setStats(ParseStats *stats);
+    };
+
+    /// <summary>
+    /// Read-only view of a file's contents. Where available (POSIX systems) the
+    /// file is memory-mapped, so no copy of it is made on the heap and its pages
+    /// are shared with other processes through the page cache. Elsewhere, the
+    /// file is read into a buffer owned by the MappedFile.
+    /// </summary>
+    class MappedFile {
+        const char *m_data = nullptr;
+        size_t m_size = 0;
+        bool m_mapped = false;
+
+        // Fallback storage when the file cannot be memory-mapped.
+        std::string m_buffer;
+
+    public:
+        MappedFile() = default;
+
+        explicit MappedFile(const std::string &filename);
+
+        MappedFile(const MappedFile &other) = delete;
+
+        MappedFile(MappedFile &&other) noexcept;
+
+        ~MappedFile();
+
+        MappedFile &operator=(const MappedFile &other) = delete;
+
+        MappedFile &operator=(MappedFile &&other) noexcept;
+
+        /// <summary>
+        /// Returns the file's contents.
+        /// </summary>
+        [[nodiscard]] std::string_view view() const;
+
+        /// <summary>
+        /// Unmaps (or frees) the file's contents.
+        /// </summary>
+        void close();
+    };
+
+    /// <summary>
+    /// Owns a parsed JSON tree along with the monotonic arena that all of its
+    /// strings and containers are allocated from. Nothing in the tree is freed
+    /// individually: the whole arena is released at once when the Document is
+    /// cleared or destroyed.
+    ///
+    /// Documents loaded with `parseFile()` also keep the file mapped, and long
+    /// strings in the tree are views into the mapping rather than copies.
+    ///
+    /// The tree is read-only. Copy the root (or any subtree) into a JsonObject
+    /// to get an independent, heap-owned tree which can be modified.
+    ///
+    /// Lazy Documents keep a copy of the source string (or the mapping) and a
+    /// Parser, which parses each array and dictionary when it is first accessed.
+    /// </summary>
+    class Document {
+#if JSON_ENABLE_STATS == true
+        // Counts the blocks the arena allocates.
+        CountingResource m_upstream;
+        std::pmr::monotonic_buffer_resource m_arena{&m_upstream};
+#else
+        std::pmr::monotonic_buffer_resource m_arena;
+#endif
+        MappedFile m_file;
+        JsonObject m_root;
+
+        // Parser for the lazy tree, which expands it as it is accessed, and for
+        // parses which collect ParseStats.
+        Parser m_parser;
+
+        // Arenas of the runs of a parallel parse, which the tree also borrows from.
+        std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> m_arenas;
+
+        /// <summary>
+        /// Parses `string` with `m_parser`, counting into `stats`.
+        /// </summary>
+        const JsonObject &parseCounted(std::string_view string, bool borrow, ParseStats &stats);
+
+    public:
+        Document() = default;
+
+        /// <summary>
+        /// Creates a Document whose arena starts with a block of
+        /// `initialSize` bytes.
+        /// </summary>
+        explicit Document(size_t initialSize);
+
+        Document(const Document &other) = delete;
+
+        Document &operator=(const Document &other) = delete;
+
+        /// <summary>
+        /// Parses `string` into this Document, replacing (and freeing) any
+        /// previously parsed tree.
+        /// </summary>
+        const JsonObject &parse(std::string_view string, EParseMode mode = Eager);
+
+        /// <summary>
+        /// Parses `string` into this Document using the given (reusable) Parser.
+        /// </summary>
+        const JsonObject &parse(std::string_view string, Parser &parser);
+
+        /// <summary>
+        /// Memory-maps the file `filename` and parses it into this Document,
+        /// keeping the mapping alive for as long as the tree.
+        /// </summary>
+        const JsonObject &parseFile(const std::string &filename, EParseMode mode = Eager);
+
+        const JsonObject &parseFile(const std::string &filename, Parser &parser);
+
+        /// <summary>
+        /// Parses `string` or the file `filename` into this Document, adding to
+        /// `stats`.
+        /// </summary>
+        const JsonObject &parse(std::string_view string, ParseStats &stats);
+
+        const JsonObject &parseFile(const std::string &filename, ParseStats &stats);
+
+        /// <summary>
+        /// Returns the root of the parsed tree.
+        /// </summary>
+        [[nodiscard]] const JsonObject &root() const;
+
+        /// <summary>
+        /// Drops the parsed tree, releases all memory held by the arena and
+        /// unmaps any mapped file.
+        /// </summary>
+        void clear();
+    };
+
+    /// <summary>
+    /// A query selecting values in a JSON tree, compiled once from either an
+    /// RFC 6901 JSON Pointer ("/bufferViews/0/byteLength", where "~1" is "/"
+    /// and "~0" is "~") or a path ("$.bufferViews[*].byteLength",
+    /// "$['key'][0]", where "*" matches every element or entry).
+    ///
+    /// Paths can be evaluated against a tree, without copying anything or
+    /// throwing on missing keys, or directly over JSON text, in which case only
+    /// the matching values are parsed and everything else is skipped.
+    /// </summary>
+    class Path {
+        struct Step {
+            enum EKind : std::uint8_t {
+                Key,   // Dictionary key, or array index if `index` is set
+                Index, // Array index
+                Any    // Every element or entry
+            };
+
+            EKind kind = Key;
+            std::string key;
+            size_t index = std::string_view::npos;
+        };
+
+        std::vector<Step> m_steps;
+
+        // Whether any step can match more than one value.
+        bool m_wildcard = false;
+
+        void compilePointer(std::string_view pointer);
+
+        void compilePath(std::string_view path);
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+
+        bool evaluate(const JsonObject &value, size_t step, std::vector<const JsonObject *> &matches,
+                      bool all) const;
+
+        bool evaluate(Lexer &lexer, const Token &token, size_t step, Parser &parser,
+                      std::vector<JsonObject> &matches) const;
+
+#pragma clang diagnostic pop
+
+    public:
+        /// <summary>
+        /// Compiles `path`, a JSON Pointer if it is empty or starts with '/',
+        /// otherwise a path starting with '$'.
+        /// </summary>
+        explicit Path(std::string_view path);
+
+        /// <summary>
+        /// Returns the first value `root` matches, or nullptr if there is none.
+        /// </summary>
+        [[nodiscard]] const JsonObject *find(const JsonObject &root) const;
+
+        /// <summary>
+        /// Returns every value `root` matches, in document order.
+        /// </summary>
+        [[nodiscard]] std::vector<const JsonObject *> findAll(const JsonObject &root) const;
+
+        /// <summary>
+        /// Evaluates this path over the JSON text `json` without building a tree,
+        /// parsing only the matching values. Paths without wildcards stop at the
+        /// first match, so with duplicate keys the first is used.
+        /// </summary>
+        [[nodiscard]] std::vector<JsonObject> extract(std::string_view json) const;
+
+        /// <summary>
+        /// Returns the number of steps in this path.
+        /// </summary>
+        [[nodiscard]] size_t size() const;
+    };
+
+    /// <summary>
+    /// Receives the contents of a JSON document as a sequence of events, in
+    /// document order, from `readString()` or `readFile()`. No tree is built,
+    /// and memory use depends only on how deeply values nest.
+    ///
+    /// Strings and keys are passed decoded, and are valid only for the duration
+    /// of the call. They view the source unless they contain escapes, which are
+    /// decoded into a buffer reused for each string.
+    ///
+    /// Override the events of interest; the rest are ignored. Returning false
+    /// from any event stops reading.
+    /// </summary>
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+
+        virtual bool onNull() { return true; }
+
+        virtual bool onBool([[maybe_unused]] bool value) { return true; }
+
+        virtual bool onInt64([[maybe_unused]] std::int64_t value) { return true; }
+
+        // Integers above INT64_MAX
+        virtual bool onUInt64([[maybe_unused]] std::uint64_t value) { return true; }
+
+        virtual bool onDouble([[maybe_unused]] double value) { return true; }
+
+        virtual bool onString([[maybe_unused]] std::string_view value) { return true; }
+
+        virtual bool onStartObject() { return true; }
+
+        virtual bool onKey([[maybe_unused]] std::string_view key) { return true; }
+
+        virtual bool onEndObject([[maybe_unused]] size_t size) { return true; }
+
+        virtual bool onStartArray() { return true; }
+
+        virtual bool onEndArray([[maybe_unused]] size_t size) { return true; }
+    };
+
+    /// <summary>
+    /// Parses JSON which arrives in chunks, such as from a socket. Chunks passed
+    /// to `feed()` may split tokens anywhere, including inside strings and
+    /// numbers; parsing resumes where the previous chunk left off, and only the
+    /// unfinished token is buffered between chunks.
+    ///
+    /// The input is a sequence of top level values separated by whitespace. Each
+    /// is available from `next()` as soon as it closes, and owns its contents.
+    /// </summary>
+    class PushParser {
+        enum EState : std::uint8_t {
+            Value,      // A value
+            FirstValue, // A value or ']', after '['
+            FirstKey,   // A key or '}', after '{'
+            Key,        // A key, after ','
+            Colon,      // ':', after a key
+            Separator   // ',' or the end of the container, after a value
+        };
+
+        struct Frame {
+            bool dict;
+            size_t base;
+        };
+
+        EState m_state = Value;
+
+        // The token split across chunks so far, and its type. The type is End
+        // when no token is split.
+        std::string m_partial;
+        EValueType m_partialType = EValueType::End;
+
+        // Scratch buffer which escaped strings and keys are decoded into.
+        std::string m_scratch;
+
+        // Whether the split string ends in a backslash, escaping the next character
+        bool m_escape = false;
+
+        // Containers which are open, with their parsed values and keys
+        std::vector<Frame> m_frames;
+        std::vector<JsonObject> m_stack;
+        std::vector<JsonKey> m_keys;
+
+        // Top level values which have closed, but not been taken
+        std::deque<JsonObject> m_values;
+
+        // Bytes fed before the current chunk, for error messages
+        size_t m_consumed = 0;
+
+        size_t scan(std::string_view chunk, size_t offset);
+
+        void token(EValueType type, std::string_view text, size_t offset);
+
+        void value(JsonObject value);
+
+        void close(EValueType type, size_t offset);
+
+    public:
+        /// <summary>
+        /// Parses the next chunk of input. Throws on malformed input.
+        /// </summary>
+        void feed(std::string_view chunk);
+
+        /// <summary>
+        /// Signals the end of input, completing a trailing top level number.
+        /// Throws if a value is unfinished.
+        /// </summary>
+        void finish();
+
+        /// <summary>
+        /// Returns the next completed top level value, if any.
+        /// </summary>
+        std::optional<JsonObject> next();
+
+        /// <summary>
+        /// Returns the number of completed values waiting to be taken.
+        /// </summary>
+        [[nodiscard]] size_t ready() const;
+
+        /// <summary>
+        /// Returns the parser to its initial state, discarding any input.
+        /// </summary>
+        void reset();
+    };
+
+    /// <summary>
+    /// Reads JSON Lines (NDJSON) input, which holds one JSON value per line,
+    /// from a memory-mapped file or a stream. One Parser, arena and input
+    /// buffer are reused for every line, so reading a record costs no more
+    /// setup than lexing it. Blank lines are skipped.
+    /// </summary>
+    class LineReader {
+        MappedFile m_file;
+
+        // Stream input is read in blocks into `m_buffer`. The unread input is
+        // `m_input` from `m_offset`.
+        std::istream *m_stream = nullptr;
+        std::string m_buffer;
+        std::string_view m_input;
+        size_t m_offset = 0;
+
+        // Each value is parsed into `m_arena`, whose first block is reused
+        // once the next line is read.
+        std::vector<std::byte> m_block;
+        std::pmr::monotonic_buffer_resource m_arena;
+        Parser m_parser;
+
+        // The number of lines read, including blank lines.
+        size_t m_line = 0;
+
+        static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+        bool fill();
+
+    public:
+        /// <summary>
+        /// Memory-maps the file `filename` for reading.
+        /// </summary>
+        explicit LineReader(const std::string &filename);
+
+        /// <summary>
+        /// Reads from `stream`, BLOCK_SIZE bytes at a time.
+        /// </summary>
+        explicit LineReader(std::istream &stream);
+
+        LineReader(const LineReader &other) = delete;
+
+        LineReader &operator=(const LineReader &other) = delete;
+
+        /// <summary>
+        /// Parses the next line. The value is valid until the next call.
+        /// Throws on malformed lines, including lines with anything but
+        /// whitespace after their value, with the line number in the message.
+        /// </summary>
+        /// <returns>The value, or nullptr at the end of input.</returns>
+        const JsonObject *next();
+
+        /// <summary>
+        /// Returns the number of the line last read, counting from 1.
+        /// </summary>
+        [[nodiscard]] size_t line() const;
+    };
+
+    /// <summary>
+    /// Writes JSON Lines output: each value compactly on its own line.
+    /// </summary>
+    class LineWriter {
+        Writer m_writer;
+
+    public:
+        /// <summary>
+        /// Creates a LineWriter which appends to `output`.
+        /// </summary>
+        explicit LineWriter(std::string &output);
+
+        /// <summary>
+        /// Creates a LineWriter which writes to `stream` through a bounded buffer.
+        /// </summary>
+        explicit LineWriter(std::ostream &stream);
+
+        void write(const JsonObject &value);
+
+        /// <summary>
+        /// Writes any buffered output to the stream.
+        /// </summary>
+        void flush();
+    };
+
+    /// <summary>
+    /// A fixed set of worker threads which run submitted tasks. Each worker has
+    /// its own queue, taking its newest task first and stealing the oldest task
+    /// of another worker when its own queue is empty. Threads which wait for
+    /// tasks (in `parallelFor()`) run queued tasks in the meantime, so tasks may
+    /// themselves wait on the pool.
+    /// </summary>
+    class ThreadPool {
+        struct Queue {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> m_queues;
+        std::vector<std::thread> m_threads;
+
+        // Sleeping workers wait on `m_wake` for `m_queued` to become non-zero.
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::atomic<size_t> m_queued = 0;
+        bool m_stop = false;
+
+        // Where tasks submitted from outside the pool are queued next.
+        std::atomic<size_t> m_nextQueue = 0;
+
+        /// <summary>
+        /// Runs one task, from queue `self` if it has any, otherwise stolen from
+        /// another queue. Returns false if there were none.
+        /// </summary>
+        bool runOne(size_t self);
+
+        void work(size_t index);
+
+    public:
+        /// <summary>
+        /// Starts `threads` workers, or one per hardware thread if 0.
+        /// </summary>
+        explicit ThreadPool(size_t threads = 0);
+
+        ThreadPool(const ThreadPool &other) = delete;
+
+        ThreadPool &operator=(const ThreadPool &other) = delete;
+
+        /// <summary>
+        /// Runs the remaining tasks, then stops the workers.
+        /// </summary>
+        ~ThreadPool();
+
+        [[nodiscard]] size_t size() const;
+
+        /// <summary>
+        /// Queues `task` to run on a worker. Tasks must not throw.
+        /// </summary>
+        void submit(std::function<void()> task);
+
+        /// <summary>
+        /// Calls `body(i)` for every `i` below `count` on the pool and the
+        /// calling thread, and returns once all calls have finished. The first
+        /// exception thrown by `body` is rethrown, and stops further calls.
+        /// </summary>
+        void parallelFor(size_t count, const std::function<void(size_t)> &body);
+
+        /// <summary>
+        /// Returns the pool shared by parallel parses, with one worker per
+        /// hardware thread, started on first use.
+        /// </summary>
+        static ThreadPool &shared();
     };
 } // namespace JSON
 
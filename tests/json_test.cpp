@@ -0,0 +1,1070 @@
+#include "json.h"
+
+#include <filesystem>
+#include <limits>
+#include <random>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+using namespace JSON;
+
+// Checks
+static int g_failures = 0;
+
+#define CHECK(condition) \
+    if (!(condition)) \
+    { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+        g_failures++; \
+    }
+
+// Checks that `statement` throws a std::exception whose message contains `text`
+#define CHECK_THROWS(statement, text) \
+    try \
+    { \
+        statement; \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": " #statement " did not throw\n"; \
+        g_failures++; \
+    } \
+    catch (const std::exception& e) \
+    { \
+        if (std::string(e.what()).find(text) == std::string::npos) \
+        { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": unexpected error: " << e.what() << "\n"; \
+            g_failures++; \
+        } \
+    }
+
+// Documents
+static std::string compact(const JsonObject& value)
+{
+    return value.format({.pretty = false});
+}
+
+static std::string readExample(const std::string& name)
+{
+    return std::string(MappedFile(std::string(CPP_JSON_EXAMPLES_DIR) + "/" + name).view());
+}
+
+/// <summary>
+/// An array of `count` records with strings that need escaping, numbers of
+/// each kind, long (interned) keys and nested containers, followed by a large
+/// nested dictionary, so that parallel parses and writes split it at several
+/// levels.
+/// </summary>
+static std::string makeLarge(size_t count)
+{
+    std::string text = "[\n";
+    for (size_t i = 0; i < count; i++)
+    {
+        text += i == 0 ? "  " : " ,\n  ";
+        text += "{\"id\": " + std::to_string(i) + ", \"name\": \"item [" + std::to_string(i) +
+                "], \\\"quoted\\\" {x: y}\", \"a_rather_long_key_name\": " + std::to_string(i * 0.25) +
+                ", \"big\": 18446744073709551615, \"tags\": [true, false, null, [], {}]}";
+    }
+    text += ",\n  {";
+    for (size_t i = 0; i < count; i++)
+    {
+        text += (i == 0 ? "\"k" : ", \"k") + std::to_string(i) + "\": [\"v\\\\" + std::to_string(i) + "\", -1.5e3]";
+    }
+    text += "}\n]\n";
+    return text;
+}
+
+static const std::string& largeDocument()
+{
+    static const std::string text = makeLarge(6000);
+    return text;
+}
+
+// Tests
+static void testAccessors()
+{
+    std::string text = R"({"s": "a string longer than the inline limit", "t": "short", "i": -3, "b": true,
+                           "a": [1, "two", null], "d": {"x": 1, "y": [2]}, "e": [], "f": {}})";
+    Document eager, lazy;
+    for (const JsonObject* root : {&loadString(text, eager), &loadString(text, lazy, Lazy)})
+    {
+        CHECK(root->size() == 8);
+        CHECK(root->hasKey("s") && root->hasKey("f") && !root->hasKey("z") && !root->hasKey(""));
+        CHECK((*root)["s"].getStringView() == "a string longer than the inline limit");
+        CHECK((*root)["t"].getStringView() == "short" && (*root)["t"].getString() == "short");
+        CHECK(static_cast<std::string_view>((*root)["t"]) == "short");
+        CHECK((*root)["i"].getInt64() == -3 && (*root)["i"].getInt() == -3 && (*root)["b"].getBool());
+
+        const JsonObject& array = (*root)["a"];
+        CHECK(array.size() == 3 && array.getArrayRef().size() == 3);
+        std::span<const JsonObject> span = array.getArraySpan();
+        CHECK(span.size() == 3 && span[1].getStringView() == "two" && span[2].type() == Null);
+        CHECK(array[0].getInt64() == 1 && &array[1] == &span[1]);
+
+        const JsonObject& dict = (*root)["d"];
+        CHECK(dict.size() == 2 && dict.getDictRef().size() == 2 && dict["y"].size() == 1);
+        CHECK(dict.find("x") == &dict["x"] && dict.find("z") == nullptr);
+        CHECK((*root)["e"].size() == 0 && (*root)["f"].size() == 0 && !(*root)["f"].hasKey("x"));
+
+        // Wrong types, missing keys and out of range indices throw
+        CHECK_THROWS((*root)["z"], "Missing key: z");
+        CHECK_THROWS(array[3], "Index out of bounds: 3");
+        CHECK_THROWS(array[-1], "Index out of bounds: -1");
+        CHECK_THROWS(array["x"], "wanted Dictionary");
+        CHECK_THROWS(dict[0], "wanted Array");
+        CHECK_THROWS((void)array.hasKey("x"), "not a Dictionary");
+        CHECK_THROWS((void)(*root)["i"].size(), "No size");
+        CHECK_THROWS((void)(*root)["i"].getStringView(), "wanted String");
+        CHECK_THROWS((void)dict.getArrayRef(), "wanted Array");
+        CHECK_THROWS((void)array.getDictRef(), "wanted Dictionary");
+    }
+}
+
+static void testValueSemantics()
+{
+    // Scalars and strings either side of the inline limit
+    std::string inlineString(14, 'i');
+    std::string heapString(15, 'h');
+    JsonObject values[] = {JsonObject(), JsonObject(true), JsonObject(INT64_MIN), JsonObject(UINT64_MAX),
+                           JsonObject(-0.25), JsonObject(inlineString), JsonObject(heapString)};
+    for (const JsonObject& value : values)
+    {
+        JsonObject copy(value);
+        JsonObject assigned(1);
+        assigned = value;
+        CHECK(copy.type() == value.type() && compact(copy) == compact(value));
+        CHECK(assigned.type() == value.type() && compact(assigned) == compact(value));
+
+        JsonObject source(value);
+        JsonObject moved(std::move(source));
+        CHECK(compact(moved) == compact(value) && source.type() == Null);
+        JsonObject moveAssigned(heapString);
+        moveAssigned = std::move(moved);
+        CHECK(compact(moveAssigned) == compact(value) && moved.type() == Null);
+    }
+    CHECK(values[5].getString() == inlineString && values[6].getString() == heapString);
+
+    // Copies of containers are deep, and moves steal the payload
+    JsonObject array(JsonArray{JsonObject(1), JsonObject(heapString), JsonObject(JsonDict{{"k", JsonObject(2)}})});
+    JsonObject copy = array;
+    copy.asArray().ptr()->push_back(JsonObject(3));
+    copy[2]["k"] = JsonObject(4);
+    CHECK(array.size() == 3 && copy.size() == 4 && array[2]["k"].getInt64() == 2);
+    const JsonObject* element = &array[1];
+    JsonObject moved = std::move(array);
+    CHECK(array.type() == Null && &moved[1] == element);
+    JsonObject& self = moved;
+    moved = self;
+    CHECK(moved.size() == 3 && moved[1].getString() == heapString);
+
+    // Copies of values borrowed from a Document own their payload, and copies
+    // of lazy values are parsed first
+    JsonObject owned, ownedLazy;
+    {
+        std::string text = R"({"a": [")" + heapString + R"(", {"b": null}]})";
+        Document document, lazy;
+        owned = loadString(text, document)["a"];
+        ownedLazy = loadString(text, lazy, Lazy)["a"];
+        text.assign(text.size(), ' ');
+    }
+    CHECK(compact(owned) == "[\"" + heapString + "\",{\"b\":null}]");
+    CHECK(compact(ownedLazy) == compact(owned));
+}
+
+static void testNumbers()
+{
+    // Integers take the narrowest of Int, UInt and Double which holds them
+    CHECK(parseNumber("0").type() == Int && parseNumber("-0").getInt64() == 0);
+    CHECK(parseNumber("9223372036854775807").type() == Int);
+    CHECK(parseNumber("9223372036854775807").getInt64() == INT64_MAX);
+    CHECK(parseNumber("-9223372036854775808").getInt64() == INT64_MIN);
+    CHECK(parseNumber("9223372036854775808").type() == UInt);
+    CHECK(parseNumber("9223372036854775808").getUInt64() == std::uint64_t(INT64_MAX) + 1);
+    CHECK(parseNumber("18446744073709551615").getUInt64() == UINT64_MAX);
+    CHECK(parseNumber("18446744073709551616").type() == Double);
+    CHECK(parseNumber("18446744073709551616").getDouble() == 18446744073709551616.0);
+    CHECK(parseNumber("-9223372036854775809").type() == Double);
+    CHECK(parseNumber("-9223372036854775809").getDouble() == -9223372036854775808.0);
+    CHECK_THROWS((void)parseNumber("9223372036854775808").getInt64(), "does not fit in int64");
+    CHECK(parseNumber("2147483647").getInt() == INT_MAX);
+    CHECK_THROWS((void)parseNumber("2147483648").getInt(), "does not fit in int");
+
+    // Fractions and exponents are always Double
+    CHECK(parseNumber("1e10").type() == Double && parseNumber("1e10").getDouble() == 1e10);
+    CHECK(parseNumber("1E+2").getDouble() == 100.0 && parseNumber("2.0").type() == Double);
+    CHECK(parseNumber("-1.5e-3").getDouble() == -1.5e-3 && parseNumber("0.1").getDouble() == 0.1);
+    CHECK(parseNumber("1.7976931348623157e308").getDouble() == 1.7976931348623157e308);
+    CHECK(parseNumber("4.9e-324").getDouble() == 4.9e-324);
+
+    // Underflow rounds to zero, keeping the sign, but overflow is an error
+    CHECK(parseNumber("1e-400").getDouble() == 0.0 && !std::signbit(parseNumber("1e-400").getDouble()));
+    CHECK(std::signbit(parseNumber("-1e-400").getDouble()));
+    CHECK_THROWS(parseNumber("1e400"), "Number out of range: 1e400");
+
+    // Which of the two it is depends on the digits as well as the exponent
+    std::string zeros(400, '0');
+    CHECK(parseNumber("0." + zeros + "1").getDouble() == 0.0);
+    CHECK(std::signbit(parseNumber("-0." + zeros + "1").getDouble()));
+    CHECK(parseNumber("0." + zeros + "1e+50").getDouble() == 0.0);
+    CHECK(parseNumber("1" + zeros + "e-800").getDouble() == 0.0);
+    CHECK_THROWS(parseNumber("1" + zeros), "Number out of range");
+    CHECK_THROWS(parseNumber("1" + zeros + "e-5"), "Number out of range");
+    CHECK_THROWS(parseNumber("1." + zeros + "e400"), "Number out of range");
+    CHECK_THROWS(parseNumber("-1.8e308"), "Number out of range");
+
+    for (const char* invalid : {"", "-", "+1", "01", "-01", "00", "1.", ".5", "1.e5", "1e", "1e+", "1e-",
+                                "0x10", "1.5.5", "1e5e5", "--1", "1-", "Infinity", "NaN"})
+    {
+        CHECK_THROWS(parseNumber(invalid), "");
+    }
+
+    // The same grammar applies when parsing documents
+    Document document;
+    CHECK(compact(loadString("[0, -0, 1e2, 18446744073709551615, -1.5]", document)) ==
+          "[0,0,100.0,18446744073709551615,-1.5]");
+    CHECK_THROWS(loadString("[01]", document), "Invalid number: 01");
+    CHECK_THROWS(loadString("[1.]", document), "Invalid number: 1.");
+    CHECK_THROWS(loadString("[-]", document), "Invalid number: -");
+    CHECK_THROWS(loadString("[1e999]", document), "Number out of range");
+}
+
+static void testEscapes()
+{
+    // Strings and keys built in C++ are escaped when written, and read back unchanged
+    std::string text = std::string("a\"b\\c/\n\r\t\b\f") + '\0' + "\x01\x1f é";
+    std::string key = "a long key with a \"quote\"\nand a newline";
+    JsonDict dict;
+    dict.insert_or_assign(key, JsonObject(text));
+    dict.insert_or_assign("\t\\", JsonObject(std::string("short")));
+    JsonObject record(std::move(dict));
+    CHECK(compact(JsonObject(text)) == R"("a\"b\\c/\n\r\t\b\f\u0000\u0001\u001f é")");
+    CHECK(compact(record).find('\n') == std::string::npos);
+
+    // Enough records for a parallel parse to split them
+    JsonObject root(JsonArray(20000, record));
+    std::string expected = compact(root);
+    for (bool pretty : {true, false})
+    {
+        std::string formatted = root.format({.pretty = pretty});
+        for (EParseMode mode : {Eager, Lazy, Parallel})
+        {
+            Document document;
+            const JsonObject& parsed = loadString(formatted, document, mode);
+            const JsonDict& first = parsed.getArrayRef()[0].getDictRef();
+            CHECK(first.find(key) != first.end() && first.find(key)->second.getStringView() == text);
+            CHECK(first.find("\t\\") != first.end());
+            CHECK(compact(parsed) == expected);
+        }
+    }
+    PushParser push;
+    push.feed(compact(record));
+    push.finish();
+    std::optional<JsonObject> pushed = push.next();
+    CHECK(pushed && compact(*pushed) == compact(record));
+
+    // Escapes in the source are decoded, including surrogate pairs
+    Document document;
+    const JsonObject& decoded = loadString(R"(["\u00e9\ud83d\ude00\/\u0041", {"a\u0062": 1}])", document);
+    CHECK(decoded.getArrayRef()[0].getStringView() == "\xc3\xa9\xf0\x9f\x98\x80/A");
+    CHECK(decoded.getArrayRef()[1].hasKey("ab"));
+    CHECK(compact(decoded) == "[\"\xc3\xa9\xf0\x9f\x98\x80/A\",{\"ab\":1}]");
+    CHECK_THROWS(loadString(R"(["\x"])", document), "Invalid escape '\\x'");
+    CHECK_THROWS(loadString(R"(["\u12"])", document), "Invalid \\u escape");
+    CHECK_THROWS(loadString(R"(["\ud83d"])", document), "Unpaired surrogate");
+    CHECK_THROWS(loadString(R"(["\ude00\ud83d"])", document), "Unpaired surrogate");
+}
+
+static void testFormatOptions()
+{
+    std::string text = R"({"b": [2, 1, {"z": "q\"\n", "a": []}], "a": {}, "c": null})";
+    JsonObject root = loadString(text);
+
+    // The default is pretty, with four spaces and keys in stored order
+    CHECK(root.format() == "{\n"
+                           "    \"b\": \n"
+                           "    [\n"
+                           "        2,\n"
+                           "        1,\n"
+                           "        {\n"
+                           "            \"z\": \"q\\\"\\n\",\n"
+                           "            \"a\": \n"
+                           "            [\n"
+                           "            ]\n"
+                           "        }\n"
+                           "    ],\n"
+                           "    \"a\": \n"
+                           "    {\n"
+                           "    },\n"
+                           "    \"c\": null\n"
+                           "}");
+    CHECK(root.format() == root.format(FormatOptions{}));
+
+    // Compact output has no whitespace at all, and parses back to the same value
+    std::string minified = R"({"b":[2,1,{"z":"q\"\n","a":[]}],"a":{},"c":null})";
+    CHECK(root.format({.pretty = false}) == minified);
+    std::string reparsed = minified;
+    CHECK(compact(loadString(reparsed)) == minified);
+
+    // Sorting orders the keys of every dictionary, but not array elements
+    CHECK(root.format({.pretty = false, .sortKeys = true}) == R"({"a":{},"b":[2,1,{"a":[],"z":"q\"\n"}],"c":null})");
+    CHECK(root.format({.indentWidth = 2, .sortKeys = true}) == "{\n"
+                                                               "  \"a\": \n"
+                                                               "  {\n"
+                                                               "  },\n"
+                                                               "  \"b\": \n"
+                                                               "  [\n"
+                                                               "    2,\n"
+                                                               "    1,\n"
+                                                               "    {\n"
+                                                               "      \"a\": \n"
+                                                               "      [\n"
+                                                               "      ],\n"
+                                                               "      \"z\": \"q\\\"\\n\"\n"
+                                                               "    }\n"
+                                                               "  ],\n"
+                                                               "  \"c\": null\n"
+                                                               "}");
+    CHECK(root.format({.indentWidth = 0}) == "{\n\"b\": \n[\n2,\n1,\n{\n\"z\": \"q\\\"\\n\",\n\"a\": \n[\n]\n}\n],\n"
+                                             "\"a\": \n{\n},\n\"c\": null\n}");
+
+    // Each Writer keeps its own options
+    std::string first, second;
+    Writer pretty(first, {.indentWidth = 1});
+    Writer minifying(second, {.pretty = false});
+    pretty.write(root["a"]);
+    minifying.write(root["b"]);
+    pretty.write(root["b"][2]["a"]);
+    CHECK(first == "{\n}[\n]" && second == R"([2,1,{"z":"q\"\n","a":[]}])");
+}
+
+static void testDoubles()
+{
+    // The shortest digits which read back as the same value, with whole
+    // numbers kept recognisable as doubles
+    const std::pair<double, const char*> expected[] = {
+        {0.1, "0.1"},
+        {0.1 + 0.2, "0.30000000000000004"},
+        {1e-9, "1e-09"},
+        {1e21, "1e+21"},
+        {100.0, "100.0"},
+        {123456789012345680.0, "123456789012345680.0"},
+        {-2.5, "-2.5"},
+        {0.0, "0.0"},
+        {-0.0, "-0.0"},
+        {std::numeric_limits<double>::denorm_min(), "5e-324"},
+        {std::numeric_limits<double>::max(), "1.7976931348623157e+308"},
+        {std::numeric_limits<double>::quiet_NaN(), "null"},
+        {-std::numeric_limits<double>::infinity(), "null"},
+    };
+    for (const auto& [value, text] : expected)
+    {
+        CHECK(compact(JsonObject(value)) == text);
+    }
+    CHECK(compact(JsonObject(INT64_MIN)) == "-9223372036854775808");
+    CHECK(compact(JsonObject(UINT64_MAX)) == "18446744073709551615");
+
+    // Every finite double survives a round trip exactly
+    std::mt19937_64 random(13);
+    for (int i = 0; i < 100000; i++)
+    {
+        double value = std::bit_cast<double>(random());
+        if (!std::isfinite(value))
+        {
+            continue;
+        }
+        std::string text = compact(JsonObject(value));
+        JsonObject parsed = parseNumber(text);
+        CHECK(parsed.type() == Double && std::bit_cast<std::uint64_t>(parsed.getDouble()) == std::bit_cast<std::uint64_t>(value));
+        if (g_failures > 0)
+        {
+            return;
+        }
+    }
+}
+
+/// <summary>
+/// Checks that `dict` holds exactly `keys`, in order, and that every key is
+/// found at its own entry.
+/// </summary>
+static bool matchesOrder(const JsonDict& dict, const std::vector<std::string>& keys)
+{
+    if (dict.size() != keys.size())
+    {
+        return false;
+    }
+    size_t i = 0;
+    for (const auto& [key, value] : dict)
+    {
+        if (key.view() != keys[i] || dict.find(keys[i]) == dict.end() || &dict.find(keys[i])->second != &value)
+        {
+            return false;
+        }
+        i++;
+    }
+    return !dict.contains("missing") && !dict.contains("");
+}
+
+static void testDictOrder()
+{
+    // Dictionaries either side of the hash index threshold, with short and long keys
+    for (size_t count : {size_t(0), size_t(1), JsonDict::HASH_THRESHOLD - 1, JsonDict::HASH_THRESHOLD,
+                         JsonDict::HASH_THRESHOLD + 1, size_t(100)})
+    {
+        JsonDict dict;
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < count; i++)
+        {
+            // Insertion order, not key order, is kept
+            keys.push_back((i % 2 ? "a_key_long_enough_to_be_stored_out_of_line_" : "k") + std::to_string(count - i));
+            CHECK(dict.insert_or_assign(keys.back(), JsonObject(static_cast<std::int64_t>(i))).second);
+        }
+        CHECK(matchesOrder(dict, keys));
+
+        // Reassigning keeps the original position
+        for (size_t i = 0; i < count; i += 3)
+        {
+            CHECK(!dict.insert_or_assign(keys[i], JsonObject(-1)).second);
+            CHECK(dict.find(keys[i])->second.getInt64() == -1);
+        }
+        CHECK(matchesOrder(dict, keys));
+
+        // Copies and moves keep working lookups
+        JsonDict copy(dict);
+        CHECK(matchesOrder(copy, keys));
+        std::pmr::monotonic_buffer_resource arena;
+        JsonDict arenaCopy(dict, JsonDict::allocator_type(&arena));
+        CHECK(matchesOrder(arenaCopy, keys));
+        JsonDict moved(std::move(copy));
+        CHECK(matchesOrder(moved, keys));
+
+        // Erasing keeps the order of the rest, down through the threshold
+        std::mt19937 random(14);
+        while (!keys.empty())
+        {
+            size_t i = random() % keys.size();
+            CHECK(dict.erase(keys[i]) == 1);
+            CHECK(dict.erase(keys[i]) == 0);
+            keys.erase(keys.begin() + static_cast<std::ptrdiff_t>(i));
+            CHECK(matchesOrder(dict, keys));
+            if (g_failures > 0)
+            {
+                return;
+            }
+        }
+        CHECK(dict.empty());
+
+        // operator[] appends a Null value for a missing key
+        dict["x"] = JsonObject(1);
+        CHECK(dict["y"].type() == Null && dict.size() == 2 && dict.begin()->first.view() == "x");
+        dict.clear();
+        CHECK(dict.empty() && !dict.contains("x"));
+    }
+
+    // Parsed duplicate keys keep the first position and the last value
+    Document document;
+    CHECK(compact(loadString(R"({"b": 1, "a": 2, "b": 3})", document)) == R"({"b":3,"a":2})");
+}
+
+static void testPath()
+{
+    std::string text = R"({"a/b": {"m~n": [10, 20]}, "x": [{"y": 1}, {"z": 0}, {"y": [2, "3"]}],
+                           "": 5, "0": "zero", "k.e[y": true, "\u0071\"": "\n"})";
+    Document eager, lazy;
+    const JsonObject* roots[] = {&loadString(text, eager), &loadString(text, lazy, Lazy)};
+
+    // Each path, and the compact text of every value it matches
+    const std::pair<const char*, std::vector<std::string>> queries[] = {
+        {"/a~1b/m~0n/1", {"20"}},
+        {"/x/2/y/1", {"\"3\""}},
+        {"/", {"5"}},
+        {"/0", {"\"zero\""}},
+        {"/x/3", {}},
+        {"/nope/deeper", {}},
+        {"$.x[*].y", {"1", "[2,\"3\"]"}},
+        {"$.x[*]['y'][0]", {"2"}},
+        {"$['k.e[y']", {"true"}},
+        {"$[\"a/b\"]['m~n'][*]", {"10", "20"}},
+        {"$.*", {"{\"m~n\":[10,20]}", R"([{"y":1},{"z":0},{"y":[2,"3"]}])", "5", "\"zero\"", "true", R"("\n")"}},
+        {"/q\"", {R"("\n")"}},
+        {"$.x[1].y", {}},
+        {"$.x.y", {}},
+    };
+    for (const auto& [query, expected] : queries)
+    {
+        Path path(query);
+        for (const JsonObject* root : roots)
+        {
+            std::vector<std::string> found;
+            for (const JsonObject* match : path.findAll(*root))
+            {
+                found.push_back(compact(*match));
+            }
+            CHECK(found == expected);
+            const JsonObject* first = path.find(*root);
+            CHECK(expected.empty() ? first == nullptr : first != nullptr && compact(*first) == expected[0]);
+        }
+
+        // Over the text, only the matches are parsed
+        std::vector<std::string> extracted;
+        for (const JsonObject& match : path.extract(text))
+        {
+            extracted.push_back(compact(match));
+        }
+        CHECK(extracted == expected);
+    }
+
+    CHECK(Path("").size() == 0 && Path("").find(*roots[0]) == roots[0]);
+    CHECK(Path("/a~1b/m~0n/1").size() == 3 && Path("$.x[*]['y'][0]").size() == 4);
+
+    CHECK_THROWS(Path("/a~2"), "Invalid escape in JSON Pointer");
+    CHECK_THROWS(Path("/a~"), "Invalid escape in JSON Pointer");
+    CHECK_THROWS(Path("x.y"), "Path must start with '$'");
+    CHECK_THROWS(Path("$."), "Empty name in path");
+    CHECK_THROWS(Path("$.a..b"), "Empty name in path");
+    CHECK_THROWS(Path("$[0"), "Unterminated '[' in path");
+    CHECK_THROWS(Path("$[-1]"), "Invalid index in path");
+    CHECK_THROWS(Path("$[01]"), "Invalid index in path");
+    CHECK_THROWS(Path("$x"), "Unexpected character 'x' in path");
+}
+
+static void testParseStats()
+{
+    std::string text = R"([1, {"a": [true, null]}, "s"])";
+    Document document;
+    ParseStats stats;
+    const JsonObject& root = loadString(text, document, stats);
+    std::string formatted = root.format({.pretty = false}, stats);
+    CHECK(formatted == R"([1,{"a":[true,null]},"s"])");
+    if (!ParseStats::ENABLED)
+    {
+        // Nothing is measured
+        CHECK(stats.tokens == 0 && stats.nodes == 0 && stats.maxDepth == 0 && stats.bytes == 0);
+        CHECK(stats.allocations == 0 && stats.allocatedBytes == 0 && stats.formattedBytes == 0);
+        CHECK(stats.readNs == 0 && stats.parseNs == 0 && stats.formatNs == 0);
+        return;
+    }
+
+    // 15 tokens and the end of input, and 7 values nested 3 deep
+    CHECK(stats.tokens == 16 && stats.nodes == 7 && stats.maxDepth == 3);
+    CHECK(stats.bytes == text.size() && stats.formattedBytes == formatted.size());
+    CHECK(stats.allocations > 0 && stats.allocatedBytes > 0);
+
+    // Later calls add to the counts, and the depth is the deepest of all
+    loadString("[[[[0]]]]", document, stats);
+    CHECK(stats.tokens == 16 + 10 && stats.nodes == 7 + 5 && stats.maxDepth == 4);
+    CHECK(stats.bytes == text.size() + 9);
+    loadString(text, document, stats);
+    CHECK(stats.nodes == 7 + 5 + 7 && stats.maxDepth == 4);
+
+    std::filesystem::path filename = std::filesystem::temp_directory_path() / "cpp_json_test_stats.json";
+    std::ofstream(filename) << text;
+    ParseStats fileStats;
+    loadFile(filename.string(), document, fileStats);
+    CHECK(fileStats.tokens == 16 && fileStats.bytes == text.size());
+    std::filesystem::remove(filename);
+}
+
+static void testClassifier()
+{
+    // Compare the dispatched classifier with a byte at a time reference
+    std::mt19937 random(9);
+    const char characters[] = "\"\\ \n\r\t[]{}:,ax1";
+    for (int round = 0; round < 10000; round++)
+    {
+        char block[64];
+        for (char& c : block)
+        {
+            c = characters[random() % (sizeof(characters) - 1)];
+        }
+        block[random() % 64] = '\0';
+
+        BlockMasks expected;
+        for (int i = 0; i < 64; i++)
+        {
+            std::uint64_t bit = std::uint64_t(1) << i;
+            char c = block[i];
+            expected.quote |= c == '"' ? bit : 0;
+            expected.backslash |= c == '\\' ? bit : 0;
+            expected.whitespace |= (c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\0') ? bit : 0;
+            expected.open |= (c == '[' || c == '{') ? bit : 0;
+            expected.close |= (c == ']' || c == '}') ? bit : 0;
+            expected.structural |= (c == '[' || c == '{' || c == ']' || c == '}' || c == ':' || c == ',') ? bit : 0;
+        }
+        BlockMasks masks;
+        classifyBlock(block, masks);
+        CHECK(masks.quote == expected.quote);
+        CHECK(masks.backslash == expected.backslash);
+        CHECK(masks.whitespace == expected.whitespace);
+        CHECK(masks.open == expected.open);
+        CHECK(masks.close == expected.close);
+        CHECK(masks.structural == expected.structural);
+        if (g_failures > 0)
+        {
+            return;
+        }
+    }
+}
+
+static void testPushParserSplits()
+{
+    std::string texts[] = {
+        readExample("simple.json"),
+        readExample("complex.json"),
+        R"({"a\"\\é": [1, -2.5e-3, 18446744073709551615, true, false, null, "x\\"], "": {}})",
+    };
+    for (const std::string& text : texts)
+    {
+        Document document;
+        std::string expected = compact(loadString(text, document));
+
+        // Two chunks, split at every byte
+        for (size_t split = 0; split <= text.size(); split++)
+        {
+            PushParser parser;
+            parser.feed(std::string(text.substr(0, split)));
+            parser.feed(std::string(text.substr(split)));
+            parser.finish();
+            std::optional<JsonObject> value = parser.next();
+            CHECK(value && compact(*value) == expected);
+            CHECK(parser.ready() == 0);
+        }
+
+        // A byte at a time
+        PushParser parser;
+        for (char c : text)
+        {
+            parser.feed(std::string(1, c));
+        }
+        parser.finish();
+        std::optional<JsonObject> value = parser.next();
+        CHECK(value && compact(*value) == expected);
+    }
+}
+
+static void testLazy()
+{
+    for (const char* name : {"simple.json", "complex.json", "gltf.json", "large.json"})
+    {
+        std::string text = readExample(name);
+        Document eager, lazy;
+        CHECK(compact(loadString(text, lazy, Lazy)) == compact(loadString(text, eager)));
+    }
+}
+
+static void testParallelParse()
+{
+    const std::string& text = largeDocument();
+    Document eager;
+    std::string expected = compact(loadString(text, eager));
+    for (size_t threads : {1, 3, 8})
+    {
+        ThreadPool pool(threads);
+        for (bool borrow : {false, true})
+        {
+            Parser parser;
+            std::pmr::monotonic_buffer_resource arena;
+            std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> arenas;
+            CHECK(compact(parser.parseParallel(text, &arena, borrow, pool, arenas)) == expected);
+            CHECK(arenas.size() > 1);
+        }
+    }
+    Document parallel;
+    CHECK(compact(loadString(text, parallel, Parallel)) == expected);
+}
+
+static void testParallelTrailingContent()
+{
+    const std::string& text = largeDocument();
+    Document document;
+    CHECK_THROWS(loadString(text + "xyz", document, Parallel), "Invalid character 'x'");
+    CHECK_THROWS(loadString(text + " [3]", document, Parallel), "Unexpected '['");
+    CHECK_THROWS(loadString(text.substr(0, text.size() - 3), document, Parallel), "");
+    CHECK(loadString(text + " \n\t", document, Parallel).size() == 6001);
+}
+
+static void testTrailingContent()
+{
+    // Lazy parses only check the root's brackets up front, so the values are
+    // formatted to expand them
+    const std::string& text = largeDocument();
+    for (EParseMode mode : {Eager, Lazy})
+    {
+        Document document;
+        CHECK_THROWS(compact(loadString(text + "xyz", document, mode)), "Invalid character 'x'");
+        CHECK_THROWS(compact(loadString(text + " [3]", document, mode)), "Unexpected '['");
+        CHECK_THROWS(compact(loadString(text.substr(0, text.size() - 3), document, mode)), "");
+        CHECK(loadString(text + " \n\t", document, mode).size() == 6001);
+    }
+}
+
+static void testSeparators()
+{
+    for (EParseMode mode : {Eager, Lazy, Parallel})
+    {
+        Document document;
+        CHECK_THROWS(compact(loadString("[1] [2]", document, mode)), "Unexpected '[' at offset 4");
+        CHECK_THROWS(compact(loadString("12 34", document, mode)), "Unexpected '34' at offset 3");
+        CHECK_THROWS(compact(loadString("{} 5", document, mode)), "Unexpected '5' at offset 3");
+        CHECK_THROWS(compact(loadString("[1 2]", document, mode)), "Expected ',' or ']' at offset 3");
+        CHECK_THROWS(compact(loadString("[1,,2]", document, mode)), "Unexpected ',' at offset 3");
+        CHECK_THROWS(compact(loadString("[,1]", document, mode)), "Unexpected ',' at offset 1");
+        CHECK_THROWS(compact(loadString("[1,]", document, mode)), "Unexpected ']' at offset 3");
+        CHECK_THROWS(compact(loadString("{\"a\": 1 \"b\": 2}", document, mode)), "Expected ',' or '}' at offset 9");
+        CHECK_THROWS(compact(loadString("{\"a\": 1,, \"b\": 2}", document, mode)), "Expected string key");
+        CHECK_THROWS(compact(loadString("{, \"a\": 1}", document, mode)), "Expected string key");
+        CHECK_THROWS(compact(loadString("{\"a\": 1,}", document, mode)), "Expected string key");
+        CHECK(compact(loadString(" [ [] , {} , {\"a\" : [1 , 2]} ] ", document, mode)) == "[[],{},{\"a\":[1,2]}]");
+    }
+}
+
+static void testParallelFormat()
+{
+    // Enough records that the root array and the dictionary after them pass
+    // the Writer's PARALLEL_MIN_ELEMENTS and are split between threads
+    std::string text = makeLarge(10000);
+    Document document;
+    const JsonObject& root = loadString(text, document);
+    ThreadPool pool(3);
+    for (bool pretty : {true, false})
+    {
+        for (bool sortKeys : {false, true})
+        {
+            FormatOptions options{.pretty = pretty, .indentWidth = 2, .sortKeys = sortKeys};
+            std::string expected = root.format(options);
+            options.pool = &pool;
+            CHECK(root.format(options) == expected);
+
+            std::ostringstream stream;
+            {
+                Writer writer(stream, options);
+                writer.write(root);
+            }
+            CHECK(stream.str() == expected);
+
+            // Lazy containers must be expanded before the threads reach them,
+            // so each format starts from an unexpanded Document
+            Document lazy;
+            CHECK(loadString(text, lazy, Lazy).format(options) == expected);
+        }
+    }
+}
+
+static void testBatch()
+{
+    std::vector<std::string> texts;
+    for (int i = 0; i < 200; i++)
+    {
+        texts.push_back(R"({"id": )" + std::to_string(i) + R"(, "a_rather_long_key_name": ["x", )" +
+                        std::to_string(i * 2) + "]}");
+    }
+    std::vector<std::string_view> views(texts.begin(), texts.end());
+
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "cpp_json_test_batch";
+    std::filesystem::create_directories(directory);
+    std::vector<std::string> filenames;
+    for (size_t i = 0; i < texts.size(); i++)
+    {
+        filenames.push_back((directory / (std::to_string(i) + ".json")).string());
+        std::ofstream(filenames.back()) << texts[i];
+    }
+
+    ThreadPool pool(3);
+    std::vector<std::unique_ptr<Document>> strings = loadStrings(views, &pool);
+    std::vector<std::unique_ptr<Document>> files = loadFiles(filenames, &pool);
+    CHECK(strings.size() == texts.size() && files.size() == texts.size());
+    for (size_t i = 0; i < texts.size(); i++)
+    {
+        Document document;
+        std::string expected = compact(loadString(texts[i], document));
+        CHECK(compact(strings[i]->root()) == expected);
+        CHECK(compact(files[i]->root()) == expected);
+    }
+
+    std::atomic<size_t> matched = 0;
+    loadFiles(filenames, [&](size_t i, std::unique_ptr<Document> document) {
+        matched += document->root()["id"].getInt64() == static_cast<std::int64_t>(i);
+    }, &pool);
+    CHECK(matched == texts.size());
+
+    views[77] = R"({"id": })";
+    CHECK_THROWS(loadStrings(views, &pool), "Document 77: ");
+    filenames[5] = (directory / "missing.json").string();
+    CHECK_THROWS(loadFiles(filenames, &pool), "missing.json");
+    std::filesystem::remove_all(directory);
+}
+
+static void testFileTypes()
+{
+    CHECK_THROWS(loadFile(std::filesystem::temp_directory_path().string()), "Not a file");
+
+#if defined(__linux__)
+    // Pipes have no size up front, so they are read rather than mapped
+    int fds[2];
+    CHECK(::pipe(fds) == 0);
+    std::string text = "{\"a\": [1, 2]}\n[3]\n";
+    CHECK(::write(fds[1], text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+    ::close(fds[1]);
+    LineReader reader("/dev/fd/" + std::to_string(fds[0]));
+    const JsonObject* first = reader.next();
+    CHECK(first != nullptr && compact(*first) == "{\"a\":[1,2]}");
+    const JsonObject* second = reader.next();
+    CHECK(second != nullptr && compact(*second) == "[3]");
+    CHECK(reader.next() == nullptr);
+    ::close(fds[0]);
+#endif
+}
+
+static void testIteration()
+{
+    std::string text = R"({"a": [1, 2, 3], "b": [], "c": {"x": 1}})";
+    JsonObject root = loadString(text);
+    std::int64_t sum = 0;
+    for (JsonObject& value : root["a"])
+    {
+        sum += value.getInt64();
+    }
+    CHECK(sum == 6);
+    CHECK(root["b"].begin() == root["b"].end());
+    CHECK_THROWS(root["c"].begin(), "asDict().ref()");
+    CHECK_THROWS(root["a"][0].begin(), "Invalid type");
+
+    std::string entries;
+    for (const auto& [key, value] : root["c"].asDict().ref())
+    {
+        entries += std::string(key.view()) + "=" + compact(value);
+    }
+    CHECK(entries == "x=1");
+}
+
+/// <summary>
+/// Records events as text, stopping at the event numbered `stopAt`.
+/// </summary>
+class RecordingHandler : public Handler
+{
+public:
+    std::string events;
+    size_t count = 0;
+    size_t stopAt = SIZE_MAX;
+
+    // Strings and keys which view `source` rather than a decoded copy
+    std::string_view source;
+    size_t borrowed = 0;
+
+    bool record(std::string_view event, std::string_view detail = {})
+    {
+        if (!events.empty())
+        {
+            events += ' ';
+        }
+        events.append(event).append(detail);
+        return ++count != stopAt;
+    }
+
+    bool onNull() override { return record("null"); }
+    bool onBool(bool value) override { return record(value ? "true" : "false"); }
+    bool onInt64(std::int64_t value) override { return record("i", std::to_string(value)); }
+    bool onUInt64(std::uint64_t value) override { return record("u", std::to_string(value)); }
+    bool onDouble(double value) override { return record("d", std::to_string(value)); }
+    bool onString(std::string_view value) override { return view(value) && record("s:", value); }
+    bool onStartObject() override { return record("{"); }
+    bool onKey(std::string_view key) override { return view(key) && record("k:", key); }
+    bool onEndObject(size_t size) override { return record("}", std::to_string(size)); }
+    bool onStartArray() override { return record("["); }
+    bool onEndArray(size_t size) override { return record("]", std::to_string(size)); }
+
+    bool view(std::string_view text)
+    {
+        borrowed += text.data() >= source.data() && text.data() < source.data() + source.size();
+        return true;
+    }
+};
+
+static void testHandler()
+{
+    std::string text = R"({"a": [1, -2, 18446744073709551615, 0.5, "x"], "b": {}, "c": [[], {"d": null}], "e": true})";
+    std::string expected = "{ k:a [ i1 i-2 u18446744073709551615 d0.500000 s:x ]5 k:b { }0 "
+                           "k:c [ [ ]0 { k:d null }1 ]2 k:e true }4";
+    RecordingHandler handler;
+    CHECK(readString(text, handler));
+    CHECK(handler.events == expected);
+
+    // Returning false stops at that event
+    RecordingHandler stopped;
+    stopped.stopAt = 5;
+    CHECK(!readString(text, stopped));
+    CHECK(stopped.events == "{ k:a [ i1 i-2");
+
+    RecordingHandler scalar;
+    CHECK(readString(" 7 ", scalar) && scalar.events == "i7");
+
+    // Escaped strings and keys are decoded; the others still view the source
+    std::string escaped = R"({"k\"\u00e9": ["x\"y", "a\\b\n", "plain"], "key": "\ud83d\ude00"})";
+    RecordingHandler decoded;
+    decoded.source = escaped;
+    CHECK(readString(escaped, decoded));
+    CHECK(decoded.events == "{ k:k\"\xc3\xa9 [ s:x\"y s:a\\b\n s:plain ]3 k:key s:\xf0\x9f\x98\x80 }2");
+    CHECK(decoded.borrowed == 2);
+    RecordingHandler invalid;
+    CHECK_THROWS(readString(R"(["\q"])", invalid), "Invalid escape '\\q'");
+
+    // Only whitespace may follow the root value
+    for (const char* invalid : {"[1] [2]", "12 34", "{} 5", "[1 2]", "[1,,2]", "[,1]", "[1,]", "{\"a\": 1,}"})
+    {
+        RecordingHandler rejected;
+        CHECK_THROWS(readString(invalid, rejected), "");
+    }
+    RecordingHandler trailing;
+    CHECK_THROWS(readString("[1] [2]", trailing), "Unexpected '[' at offset 4");
+
+    std::filesystem::path filename = std::filesystem::temp_directory_path() / "cpp_json_test_handler.json";
+    std::ofstream(filename) << text << "\n";
+    RecordingHandler file;
+    CHECK(readFile(filename.string(), file) && file.events == expected);
+    std::ofstream(filename) << text << " {}";
+    RecordingHandler fileTrailing;
+    CHECK_THROWS(readFile(filename.string(), fileTrailing), "Unexpected '{'");
+    std::filesystem::remove(filename);
+}
+
+static void testLineReader()
+{
+    std::istringstream stream("{\"a\": 1}\n\n  [2, \"x\"]  \r\n3");
+    LineReader reader(stream);
+    const JsonObject* value = reader.next();
+    CHECK(value != nullptr && compact(*value) == "{\"a\":1}" && reader.line() == 1);
+    value = reader.next();
+    CHECK(value != nullptr && compact(*value) == "[2,\"x\"]" && reader.line() == 3);
+    value = reader.next();
+    CHECK(value != nullptr && compact(*value) == "3" && reader.line() == 4);
+    CHECK(reader.next() == nullptr);
+
+    // A second value on a line is an error, not a second record
+    std::istringstream records("[0]\n{\"a\":1} {\"b\":2}\n");
+    LineReader trailing(records);
+    CHECK(trailing.next() != nullptr);
+    CHECK_THROWS(trailing.next(), "Line 2: Unexpected '{' at offset 8");
+
+    // Numbers out of range throw std::out_of_range, and still name the line
+    std::istringstream ranges("[1]\n\n[1e400]\n");
+    LineReader range(ranges);
+    CHECK(range.next() != nullptr);
+    CHECK_THROWS(range.next(), "Line 3: Number out of range: 1e400");
+
+    // Newlines inside strings are escaped, so each record stays on one line
+    std::string output;
+    {
+        LineWriter writer(output);
+        JsonDict dict;
+        dict.insert_or_assign("multi\nline", JsonObject(std::string("one\ntwo\r\n")));
+        writer.write(JsonObject(std::move(dict)));
+        writer.write(JsonObject(std::string("\n")));
+    }
+    CHECK(std::count(output.begin(), output.end(), '\n') == 2);
+    std::istringstream written(output);
+    LineReader lines(written);
+    value = lines.next();
+    CHECK(value != nullptr && value->hasKey("multi\nline"));
+    CHECK(value != nullptr && (*value)["multi\nline"].getStringView() == "one\ntwo\r\n");
+    value = lines.next();
+    CHECK(value != nullptr && value->getStringView() == "\n" && lines.line() == 2);
+    CHECK(lines.next() == nullptr);
+}
+
+static void testKeyTableReuse()
+{
+    // Clearing after a document with many distinct keys forgets all of them
+    std::pmr::monotonic_buffer_resource arena;
+    KeyTable table;
+    std::vector<std::string> keys;
+    for (int i = 0; i < 200000; i++)
+    {
+        keys.push_back("a_fairly_long_key_name_" + std::to_string(i));
+    }
+    for (const std::string& key : keys)
+    {
+        table.intern(key, &arena, false);
+    }
+    CHECK(table.size() == keys.size());
+    CHECK(table.intern(keys[7], &arena, true).data() != keys[7].data());
+
+    table.clear();
+    CHECK(table.size() == 0);
+    for (int round = 0; round < 2; round++)
+    {
+        // Borrowed new keys are returned as given, so a key left behind by
+        // the clear would show up as a different pointer
+        for (size_t i = 0; i < 3; i++)
+        {
+            CHECK(table.intern(keys[i], &arena, true).data() == keys[i].data());
+        }
+        CHECK(table.size() == 3);
+        table.clear();
+        CHECK(table.size() == 0);
+    }
+
+    // The records after a large one are still read through the same table
+    std::string text = "{";
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        text += (i == 0 ? "\"" : ",\"") + keys[i] + "\": 1";
+    }
+    text += "}\n";
+    for (int i = 0; i < 20000; i++)
+    {
+        text += "{\"a_fairly_long_key_name_0\": 1, \"b\": [2]}\n";
+    }
+    std::istringstream stream(text);
+    LineReader reader(stream);
+    const JsonObject* first = reader.next();
+    CHECK(first != nullptr && first->size() == keys.size());
+    size_t count = 0;
+    while (const JsonObject* record = reader.next())
+    {
+        count += (*record)["a_fairly_long_key_name_0"].getInt64() == 1;
+    }
+    CHECK(count == 20000);
+}
+
+int main()
+{
+    std::cout << "Classifier: " << classifyInstructionSet() << ", stats " << (ParseStats::ENABLED ? "on" : "off") << "\n";
+    const std::pair<const char*, void (*)()> tests[] = {
+        {"accessors", testAccessors},
+        {"value semantics", testValueSemantics},
+        {"numbers", testNumbers},
+        {"escapes", testEscapes},
+        {"format options", testFormatOptions},
+        {"doubles", testDoubles},
+        {"dict order", testDictOrder},
+        {"path", testPath},
+        {"parse stats", testParseStats},
+        {"classifier", testClassifier},
+        {"push parser splits", testPushParserSplits},
+        {"lazy", testLazy},
+        {"parallel parse", testParallelParse},
+        {"parallel trailing content", testParallelTrailingContent},
+        {"trailing content", testTrailingContent},
+        {"separators", testSeparators},
+        {"parallel format", testParallelFormat},
+        {"batch", testBatch},
+        {"file types", testFileTypes},
+        {"iteration", testIteration},
+        {"handler", testHandler},
+        {"line reader", testLineReader},
+        {"key table reuse", testKeyTableReuse},
+    };
+    for (const auto& [name, test] : tests)
+    {
+        int failures = g_failures;
+        try
+        {
+            test();
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << name << ": threw " << e.what() << "\n";
+            g_failures++;
+        }
+        std::cout << (g_failures == failures ? "ok   " : "FAIL ") << name << "\n";
+    }
+    return g_failures == 0 ? 0 : 1;
+}
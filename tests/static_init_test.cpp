@@ -0,0 +1,26 @@
+#include "json.h"
+
+using namespace JSON;
+
+// Parsing and formatting while this file's globals are initialised, which may
+// be before those of json.cpp.
+static std::string g_source = "{\"a\": [1, 2, \"three\"], \"b\": {\"c\": null}}";
+
+static JsonObject g_parsed = loadString(g_source);
+
+static std::string g_formatted = JsonObject(JsonArray{JsonObject(1)}).format();
+
+int main()
+{
+    if (g_parsed.format({.pretty = false}) != "{\"a\":[1,2,\"three\"],\"b\":{\"c\":null}}")
+    {
+        std::cerr << "Parsed during static initialisation: " << g_parsed.format({.pretty = false}) << "\n";
+        return 1;
+    }
+    if (g_formatted != "[\n    1\n]")
+    {
+        std::cerr << "Formatted during static initialisation: " << g_formatted << "\n";
+        return 1;
+    }
+    return 0;
+}